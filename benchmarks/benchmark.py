@@ -0,0 +1,34 @@
+# Scripts and a runner shared by the benchmarks, so that they measure the same programs the same way.
+import os
+import resource
+import subprocess
+import sys
+
+# counts to {iterations} in a loop and leaves the count as its value
+COUNT = '''Cnt = Object^;
+mut Cnt i = 0;
+while Cnt.i < {iterations} {{
+	mut Cnt i = Cnt.i + 1;
+}}
+Cnt.i
+'''
+
+def to_repository_root():
+	# run from the repository root, where stamp and prelude.ostamp live
+	os.chdir(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..'))
+
+def write_program(path, program, **values):
+	with open(path, 'w') as fhandle:
+		fhandle.write(program.format(**values))
+
+# Runs stamp with the options on the source and returns its output and the CPU time it took. Exits if stamp fails.
+def run_stamp(binary, options, source):
+	before = resource.getrusage(resource.RUSAGE_CHILDREN).ru_utime
+	proc = subprocess.Popen([binary] + options + [source], stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+	stdout, stderr = proc.communicate()
+	elapsed = resource.getrusage(resource.RUSAGE_CHILDREN).ru_utime - before
+
+	if proc.returncode != 0 or stderr.decode() != '':
+		print(stderr.decode(), end='')
+		sys.exit(1)
+	return (stdout.decode(), elapsed)
@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import re
+import sys
+import tempfile
+
+from benchmark import COUNT, to_repository_root, write_program, run_stamp
+
+size_regex = re.compile('Global context size: ([0-9]+)')
+
+def run_loop(directory, iterations):
+	source = os.path.join(directory, 'count.stamp')
+	write_program(source, COUNT, iterations=iterations)
+	stdout, elapsed = run_stamp('./stamp', ['-s'], source)
+	return (int(size_regex.search(stdout).group(1)), elapsed)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='Checks that the global context does not grow with the number of loop iterations.')
+	parser.add_argument('-n', '--iterations', type=int, default=10000000, help='Iterations of the long running loop.')
+	args = parser.parse_args()
+
+	to_repository_root()
+
+	with tempfile.TemporaryDirectory() as directory:
+		baseline, _ = run_loop(directory, 1)
+		size, elapsed = run_loop(directory, args.iterations)
+	print('{} iterations: global context size {} (1 iteration: {}), {:.2f}s'.format(args.iterations, size, baseline, elapsed))
+	if size != baseline:
+		print('Global context grew with the number of iterations.')
+		sys.exit(1)
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from benchmark import COUNT, to_repository_root, write_program, run_stamp
+
+programs = {
+	'count': COUNT,
+	'branch': '''Cnt = Object^;
+mut Cnt i = 0;
+mut Cnt s = 0;
+while Cnt.i < {iterations} {{
+	if Cnt.i < {half} {{
+		mut Cnt s = Cnt.s + 2;
+	}} else {{
+		mut Cnt s = Cnt.s + 1;
+	}}
+	mut Cnt i = Cnt.i + 1;
+}}
+Cnt.s
+''',
+	'arith': '''Cnt = Object^;
+mut Cnt i = 0;
+mut Cnt s = 0;
+while Cnt.i < {iterations} {{
+	mut Cnt a = Cnt.i * 3;
+	mut Cnt a = Cnt.a >< 5;
+	mut Cnt s = Cnt.a % 1000;
+	mut Cnt i = Cnt.i + 1;
+}}
+Cnt.s
+''',
+	'call': '''Cnt = Object^;
+Object inc = fn(x) {{ return x + 1; }}
+mut Cnt i = 0;
+mut Cnt s = 0;
+while Cnt.i < {iterations} {{
+	mut Cnt s = Object.inc(Cnt.s);
+	mut Cnt i = Cnt.i + 1;
+}}
+Cnt.s
+''',
+}
+
+def build(dispatch, destination):
+	subprocess.run(['make', 'clean'], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=True)
+	subprocess.run(['make', 'stamp', 'DISPATCH=' + dispatch], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=True)
+	shutil.copy('stamp', destination)
+
+def run(binary, source, level):
+	stdout, elapsed = run_stamp(binary, ['-O{}'.format(level)], source)
+	return (stdout.strip().split('\n')[-2], elapsed)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description='Compares the threaded (computed goto) and switch dispatch loops on loop-heavy scripts.')
+	parser.add_argument('-n', '--iterations', type=int, default=1000000, help='Iterations of every loop.')
+	parser.add_argument('-r', '--runs', type=int, default=5, help='Runs per script, the fastest one is reported.')
+	parser.add_argument('-O', '--optimize', type=int, default=0, help='Optimization level the scripts are run at.')
+	args = parser.parse_args()
+
+	to_repository_root()
+
+	with tempfile.TemporaryDirectory() as directory:
+		binaries = {}
+		# the default threaded build is built last and stays in place
+		for dispatch in ['switch', 'threaded']:
+			binaries[dispatch] = os.path.join(directory, 'stamp-' + dispatch)
+			build(dispatch, binaries[dispatch])
+
+		print('{:<10}{:>12}{:>12}{:>10}'.format('script', 'switch', 'threaded', 'speedup'))
+		for name, program in programs.items():
+			source = os.path.join(directory, name + '.stamp')
+			write_program(source, program, iterations=args.iterations, half=args.iterations // 2)
+
+			times = {}
+			results = set()
+			for dispatch, binary in binaries.items():
+				runs = [run(binary, source, args.optimize) for _ in range(args.runs)]
+				results.update(result for result, _ in runs)
+				times[dispatch] = min(elapsed for _, elapsed in runs)
+			if len(results) != 1:
+				print('{}: dispatch loops disagree: {}'.format(name, results))
+				sys.exit(1)
+			print('{:<10}{:>11.3f}s{:>11.3f}s{:>9.2f}x'.format(name, times['switch'], times['threaded'], times['switch'] / times['threaded']))
@@ -1,72 +1,258 @@
 #!/usr/bin/env python3
 import argparse
+import atexit
 import subprocess
 import sys
 import os
 import re
-from progress.bar import Bar
+import shutil
+import tempfile
+
+try:
+	from progress.bar import Bar
+except ImportError:
+	# the same interface as progress' Bar, for when it is not installed
+	class Bar:
+		def __init__(self, message, max):
+			self.message = message
+			self.max = max
+			self.index = 0
+			self.show()
+
+		def show(self):
+			print('\r' + self.message + ' ' + str(self.index) + '/' + str(self.max), end='', flush=True)
+
+		def next(self):
+			self.index += 1
+			self.show()
+
+		def finish(self):
+			print()
 
 obj_regex = re.compile('([A-Z][A-Za-z_]*-)([a-z0-9]+)')
+register_regex = re.compile('^r[0-9]+ (.*)$', re.MULTILINE)
 blue = '\033[94m'
 green = '\033[92m'
 red = '\033[91m'
 endc = '\033[0m'
 autobake = True
+# directory with a prelude.ostamp written without a heap image for the current build, made when first needed
+imageless_prelude_dir = None
 
-def make_debug():
+# tests/dbg runs on a debug build and prints the AST, tests/modules runs with its modules in tests/modules/lib,
+# tests/opt prints the bytecode after each optimization pass and tests/api holds C++ programs built against
+# libstamp.a; the rest runs on a release build, tests/rel also at every optimization level and without the heap image
+# of the prelude
+max_optimization_level = 2
+
+def is_debug_test(test):
+	return test.startswith('tests/dbg')
+
+def is_rel_test(test):
+	return test.startswith('tests/rel')
+
+def is_optimizer_test(test):
+	return test.startswith('tests/opt')
+
+def is_module_test(test):
+	return test.startswith('tests/modules')
+
+def is_api_test(test):
+	return test.endswith('.cpp')
+
+def out_file(test):
+	return os.path.splitext(test)[0] + '.out'
+
+# options stamp runs the test with, from a .args file next to it
+def options_of(test):
+	args_file = os.path.splitext(test)[0] + '.args'
+	if not os.path.exists(args_file):
+		return []
+	with open(args_file, 'r') as fhandle:
+		return fhandle.read().split()
+
+def make(target):
+	global imageless_prelude_dir
+	imageless_prelude_dir = None
 	subprocess.run(['make', 'clean'], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
-	proc = subprocess.Popen(['make', 'debug'], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-	_, stderr = proc.communicate()
-	stderr = stderr.decode()
-	if (stderr != ''):
-		print(stderr, end='')
-		sys.exit(1)
+	for t in [target, 'prelude']:
+		proc = subprocess.Popen(['make', t], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+		_, stderr = proc.communicate()
+		stderr = stderr.decode()
+		if (stderr != ''):
+			print(stderr, end='')
+			sys.exit(1)
+
+def make_debug():
+	make('debug')
 
 def make_release():
-	subprocess.run(['make', 'clean'], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
-	proc = subprocess.Popen(['make'], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-	_, stderr = proc.communicate()
-	stderr = stderr.decode()
-	if (stderr != ''):
-		print(stderr, end='')
-		sys.exit(1)
+	make('all')
 
-def run_test(test):
-	proc = subprocess.Popen(['./stamp', test], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+def run(command, cwd=None):
+	proc = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, cwd=cwd)
 	stdout, stderr = proc.communicate()
 	return (stdout.decode(), stderr.decode())
 
-def produce_test_out(test):
-	stdout, stderr = run_test(test)
+def run_test(test):
+	if is_debug_test(test):
+		return run(['./stamp', '-a', test])
+	return run(['./stamp'] + options_of(test) + [test])
+
+def format_out(stdout, stderr):
 	stdout = obj_regex.sub(r'\g<1>hash', stdout)
-	
+
 	out = 'STDOUT:\n'
 	out += stdout
 	out += 'STDERR:\n'
 	out += stderr
 	return out
 
+# Runs with a fresh copy of the modules, with caches made by an earlier run, with broken caches, with a cache directory
+# that cannot be made and after modules were replaced by their .next files. Only runs that differ from the first show.
+def run_module_test(test):
+	lib = os.path.join(os.path.dirname(test), 'lib')
+	with tempfile.TemporaryDirectory() as tmp:
+		# modules are known by their real paths, which show in errors
+		tmp_lib = os.path.join(os.path.realpath(tmp), 'lib')
+		cache = os.path.join(tmp_lib, '.stamp-cache')
+
+		def fresh():
+			shutil.rmtree(tmp_lib, ignore_errors=True)
+			shutil.copytree(lib, tmp_lib, ignore=shutil.ignore_patterns('.stamp-cache'))
+
+		def run_modules():
+			stdout, stderr = run(['./stamp', '-d', tmp_lib, test])
+			return format_out(stdout, stderr).replace(tmp_lib, lib)
+
+		def rewrite_caches(rewrite):
+			for f in os.listdir(cache) if os.path.isdir(cache) else []:
+				with open(os.path.join(cache, f), 'r+b') as fhandle:
+					rewrite(fhandle, os.path.getsize(os.path.join(cache, f)))
+
+		def corrupt(fhandle, size):
+			fhandle.seek(size // 2)
+			fhandle.write(b'\xff' * (size - size // 2))
+
+		def truncate(fhandle, size):
+			fhandle.truncate(size // 2)
+
+		def garbage(fhandle, size):
+			fhandle.write(b'garbage' * (size // 7 + 1))
+
+		def replace_next():
+			for f in os.listdir(tmp_lib):
+				if f.endswith('.next'):
+					module = os.path.join(tmp_lib, f[:-len('.next')])
+					times = os.stat(module)
+					shutil.copyfile(os.path.join(tmp_lib, f), module)
+					# caches are checked by size first, then by modification time or checksum; a replacement of the
+					# same size made a second later is stale only by its checksum
+					os.utime(module, ns=(times.st_atime_ns, times.st_mtime_ns + 1000000000))
+
+		fresh()
+		cold = run_modules()
+		runs = [('warm', run_modules())]
+		for name, rewrite in [('corrupt', corrupt), ('truncated', truncate), ('garbage', garbage)]:
+			fresh()
+			run_modules()
+			rewrite_caches(rewrite)
+			runs.append((name, run_modules()))
+		fresh()
+		open(cache, 'w').close()
+		runs.append(('unwritable', run_modules()))
+		fresh()
+		run_modules()
+		replace_next()
+		runs.append(('stale', run_modules()))
+
+	out = cold
+	for name, got in runs:
+		if got != cold:
+			out += 'RUN ' + name + ':\n' + got
+	return out
+
+def run_api_test(test):
+	with tempfile.TemporaryDirectory() as tmp:
+		binary = os.path.join(tmp, 'test')
+		stdout, stderr = run(['g++', '-std=c++17', '-pthread', '-Isrc', '-o', binary, test, 'libstamp.a'])
+		if stderr != '':
+			return format_out(stdout, stderr)
+		stdout, stderr = run([binary])
+		return format_out(stdout, stderr)
+
+# What a run shows apart from its registers, which optimizations remove and renumber: its errors and the value of the
+# last register that is not empty, leaving out the scratch register that comes last.
+def result_of(stdout, stderr):
+	values = [v for v in register_regex.findall(stdout)[:-1] if v != 'EMPTY']
+	return (obj_regex.sub(r'\g<1>hash', values[-1]) if values else None, stderr)
+
+# Runs with a prelude that is run again instead of being loaded from its heap image. stamp reads prelude.ostamp from
+# the directory it runs in, so the run is made from a directory with a prelude.ostamp written without -i.
+def run_without_heap_image(test):
+	global imageless_prelude_dir
+	stamp = os.path.abspath('stamp')
+	if imageless_prelude_dir is None:
+		imageless_prelude_dir = tempfile.mkdtemp()
+		atexit.register(shutil.rmtree, imageless_prelude_dir, True)
+		_, stderr = run([stamp, '-o', 'prelude.ostamp', os.path.abspath('prelude.stamp')], imageless_prelude_dir)
+		if stderr != '':
+			print(stderr, end='')
+			sys.exit(1)
+	stdout, stderr = run([stamp] + options_of(test) + [os.path.abspath(test)], imageless_prelude_dir)
+	return (stdout.replace(os.path.abspath(test), test), stderr.replace(os.path.abspath(test), test))
+
+# Runs unoptimized, at every optimization level and without the heap image of the prelude. Runs with results that
+# differ from the first one show.
+def run_rel_test(test):
+	stdout, stderr = run_test(test)
+	out = format_out(stdout, stderr)
+	first = out
+	unoptimized = result_of(stdout, stderr)
+	for level in range(1, max_optimization_level + 1):
+		stdout, stderr = run(['./stamp', '-O' + str(level)] + options_of(test) + [test])
+		if result_of(stdout, stderr) != unoptimized:
+			out += 'RUN -O' + str(level) + ':\n' + format_out(stdout, stderr)
+	# the same code runs, so everything it prints is the same
+	imageless = format_out(*run_without_heap_image(test))
+	if imageless != first:
+		out += 'RUN without heap image:\n' + imageless
+	return out
+
+# The bytecode of the test after each pass at the highest optimization level, followed by the optimized run. The
+# bytecode of the whole program, which -b prints after the passes, starts with the first block of the prelude.
+def run_optimizer_test(test):
+	stdout, stderr = run(['./stamp', '-O' + str(max_optimization_level), '-b', test])
+	passes = stdout.split('BB0: enters scope 0\n')[0]
+	stdout, stderr = run(['./stamp', '-O' + str(max_optimization_level), test])
+	return passes + format_out(stdout, stderr)
+
+def produce_test_out(test):
+	if is_api_test(test):
+		return run_api_test(test)
+	if is_module_test(test):
+		return run_module_test(test)
+	if is_rel_test(test):
+		return run_rel_test(test)
+	if is_optimizer_test(test):
+		return run_optimizer_test(test)
+	stdout, stderr = run_test(test)
+	return format_out(stdout, stderr)
+
 def bake(bake_list):
-	debug_list = list(filter(lambda f: f.startswith('tests/dbg'), bake_list))
-	release_list = list(filter(lambda f: not f.startswith('tests/dbg'), bake_list))
-	
-	if len(debug_list) != 0:
-		bar = Bar('Baking debug tests.  ', max=len(debug_list))
-		make_debug()
-		for i in range(len(debug_list)):
-			with open(debug_list[i].split('.')[0]+'.out', 'w') as fhandle:
-				fhandle.write(produce_test_out(debug_list[i]))
-			
-			bar.next()
+	bake_list = [os.path.relpath(f) for f in bake_list]
+	debug_list = list(filter(is_debug_test, bake_list))
+	release_list = list(filter(lambda f: not is_debug_test(f), bake_list))
 
-		bar.finish()
+	for message, tests, make_build in [('Baking debug tests.  ', debug_list, make_debug), ('Baking release tests.', release_list, make_release)]:
+		if len(tests) == 0:
+			continue
 
-	if len(release_list) != 0:
-		bar = Bar('Baking release tests.', max=len(release_list))
-		make_release()
-		for i in range(len(release_list)):
-			with open(release_list[i].split('.')[0]+'.out', 'w') as fhandle:
-				fhandle.write(produce_test_out(release_list[i]))
+		bar = Bar(message, max=len(tests))
+		make_build()
+		for test in tests:
+			with open(out_file(test), 'w') as fhandle:
+				fhandle.write(produce_test_out(test))
 
 			bar.next()
 
@@ -75,56 +261,35 @@ def bake(bake_list):
 	print('Done baking tests.')
 
 def test(tests):
-	debug_list = list(filter(lambda f: f.startswith('tests/dbg'), tests))
-	release_list = list(filter(lambda f: not f.startswith('tests/dbg'), tests))
+	tests = [os.path.relpath(f) for f in tests]
+	debug_list = list(filter(is_debug_test, tests))
+	release_list = list(filter(lambda f: not is_debug_test(f), tests))
 	failed_tests = []
 	error_log = []
-	
-	if len(debug_list) != 0:
-		bar = Bar('Running debug tests.  ', max=len(debug_list))
-		make_debug()
-		for i in range(len(debug_list)):
-			test_out = produce_test_out(debug_list[i])
 
-			bake_file = debug_list[i].split('.')[0]+'.out'
+	for message, test_list, make_build in [('Running debug tests.  ', debug_list, make_debug), ('Running release tests.', release_list, make_release)]:
+		if len(test_list) == 0:
+			continue
 
-			if (not os.path.exists(bake_file)):
-				if autobake:
-					with open(bake_file, 'w') as fhandle:
-						fhandle.write(test_out)
-				else:
-					error_log.append(blue + debug_list[i] + endc + ': No .out file found for test. Bake the test or rerun without -a to autobake.')
-			else:
-				with open(bake_file, 'r') as fhandle:
-					expected = fhandle.read()
+		bar = Bar(message, max=len(test_list))
+		make_build()
+		for test in test_list:
+			test_out = produce_test_out(test)
 
-				if test_out != expected:
-					failed_tests.append((debug_list[i], expected, test_out))
-
-			bar.next();
-	
-		bar.finish()
-
-	if len(release_list) != 0:
-		bar = Bar('Running release tests.', max=len(release_list))
-		make_release()
-		for i in range(len(release_list)):
-			test_out = produce_test_out(release_list[i])
-
-			bake_file = release_list[i].split('.')[0]+'.out'
+			bake_file = out_file(test)
 
 			if (not os.path.exists(bake_file)):
 				if autobake:
 					with open(bake_file, 'w') as fhandle:
 						fhandle.write(test_out)
 				else:
-					error_log.append(blue + release_list[i] + endc + ': No .out file found for test. Bake the test or rerun without -a to autobake.')
+					error_log.append(blue + test + endc + ': No .out file found for test. Bake the test or rerun without -a to autobake.')
 			else:
 				with open(bake_file, 'r') as fhandle:
 					expected = fhandle.read()
 
 				if test_out != expected:
-					failed_tests.append((release_list[i], expected, test_out))
+					failed_tests.append((test, expected, test_out))
 
 			bar.next();
 
@@ -141,18 +306,22 @@ def test(tests):
 	print('\nFinished running tests. ', end='')
 	print(green + 'Correct' + endc + ': ' + str(len(tests) - len(failed_tests)) + '. ', end='')
 	print(red + 'Failed' + endc + ': ' + str(len(failed_tests)) + '.')
+	return len(failed_tests) == 0
 
 def eval_all(should_test):
 	test_list = []
 	for root, subdirs, files in os.walk('tests'):
+		# modules used by module tests are not tests themselves
+		subdirs[:] = [d for d in subdirs if d != 'lib']
 		for f in files:
-			if f.endswith('.st'):
+			if f.endswith('.stamp') or (f.endswith('.cpp') and root == os.path.join('tests', 'api')):
 				test_list.append(os.path.join(root, f))
-	
+	test_list.sort()
+
 	if should_test:
-		test(test_list)
-	else:
-		bake(test_list)
+		return test(test_list)
+	bake(test_list)
+	return True
 
 if __name__ == "__main__":
 	parser = argparse.ArgumentParser(description='The Stamp language interpreter.')
@@ -163,18 +332,21 @@ if __name__ == "__main__":
 	args = parser.parse_args()
 
 	autobake = args.autobake
+	passed = True
 
 	if args.bake_list is not None:
 		if len(args.bake_list) == 0:
 			eval_all(False)
 		else:
 			bake(args.bake_list)
-	
+
 	if args.tests is not None:
 		if len(args.tests) == 0:
-			eval_all(True)
+			passed = eval_all(True)
 		else:
-			test(args.tests)
+			passed = test(args.tests)
 
 	if args.bake_list is None and args.tests is None:
-		eval_all(True)
\ No newline at end of file
+		passed = eval_all(True)
+
+	sys.exit(0 if passed else 1)
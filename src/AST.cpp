@@ -13,24 +13,30 @@
 
 #define WHILE_SCOPE_FLAGS SCOPE_CAN_CONTINUE | SCOPE_CAN_BREAK
 
+// modules used by the statements of a list and of the blocks in it
+static void find_uses(ASTNode *slist, std::vector<std::string> &names) {
+	for (auto child : slist->get_children()) {
+		if (child->token.type == Token::Use)
+			names.push_back(std::string(child->token.value));
+		else if (child->token.type == Token::SList)
+			find_uses(child, names);
+	}
+}
+
 std::optional<Register> ASTNode::generate_bytecode(Generator &generator) {
 #define __GENERATE_BASIC_OBJECT(tok, lit)                                                        \
             case tok: {                                                                          \
-        auto obj = generator.next_register();                                                    \
-		generator.append<Load>(obj, lit);                                                        \
-																								 \
-		std::optional<std::string> clone_stamp = "::lit_" + token.value; \
-		auto clone_dst = generator.next_register();                                              \
-		generator.append<Send>(clone_dst, obj, "clone", clone_stamp);                            \
-                                                                                                 \
-		std::optional<std::string> stamp = token.value;                  \
-        auto dst = generator.next_register();                                                    \
-		generator.append<Send>(dst, clone_dst, "store_value", stamp);                            \
-        return dst;                                                                              \
+		auto dst = generator.next_register();                                                    \
+		auto constant = generator.add_constant(lit, Symbol::intern(token.value));                \
+		generator.append<LoadConst>(dst, constant);                                              \
+		return dst;                                                                              \
 		}
 
 	switch (token.type) {
 		case Token::Program: {
+			std::vector<std::string> uses;
+			find_uses(this, uses);
+			generator.compile_modules(uses);
 			auto scope = generator.add_scope_beginning(0, true);
 			token.type = Token::SList;
 			generate_bytecode(generator);
@@ -56,71 +62,69 @@ std::optional<Register> ASTNode::generate_bytecode(Generator &generator) {
 		}
 		case Token::Fn: {
 			auto callable_obj = generator.next_register();
-			generator.append<Load>(callable_obj, "Callable");
+			generator.append<Load>(callable_obj, Symbols::Callable);
 			auto callable_name = generator.next_register();
-			std::optional<std::string> st = children[0]->token.value;
-			generator.append<Send>(callable_name, callable_obj, "clone_callable", st);
+			std::optional<Symbol> st = Symbol::intern(children[0]->token.value);
+			generator.append<Send>(callable_name, callable_obj, Symbols::clone_callable, st);
+			generator.append<Bind>(generator.declare(*st), callable_name);
 			auto last_register = callable_name;
 			for (long unsigned i = 1; i < children.size() - 1; i++) {
-				std::optional<std::string> stamp = children[i]->token.value;
+				std::optional<Symbol> stamp = Symbol::intern(children[i]->token.value);
 				auto temp_register = generator.next_register();
-				generator.append<Send>(temp_register, last_register, "store_param", stamp);
+				generator.append<Send>(temp_register, last_register, Symbols::store_param, stamp);
 				last_register = temp_register;
 			}
 			auto skip_function = generator.append<Jump>(0);
 			auto scope = generator.add_scope_beginning(SCOPE_CAN_RETURN, false);
+			// parameters take the first slots of the function's frame
+			for (long unsigned i = 1; i < children.size() - 1; i++)
+				generator.declare(Symbol::intern(children[i]->token.value));
+			scope->num_params = children.size() - 2;
 			std::optional<uint32_t> stamp = generator.get_num_bbs() - 1;
 			children[children.size() - 1]->generate_bytecode(generator);
-			generator.append<JumpSaved>();
+			generator.append<Return>();
 			generator.end_scope(scope);
 			skip_function->set_jump(generator.add_basic_block()->get_index());
 			auto final = generator.next_register();
-			generator.append<Send>(final, last_register, "pass_body", stamp);
+			generator.append<Send>(final, last_register, Symbols::pass_body, stamp);
 			return final;
 		}
 		case Token::FnCall: {
-			auto last_register = *children[0]->generate_bytecode(generator);
+			auto callee = *children[0]->generate_bytecode(generator);
+			std::vector<Register> arguments;
 			for (long unsigned int i = 1; i < children.size(); i++) {
 				if (children[i]->token.type == Token::Object || children[i]->token.type == Token::Value) {
-					std::optional<std::string> stamp = children[i]->token.value;
-					auto temp_register = generator.next_register();
-					generator.append<Send>(temp_register, last_register, "pass_param", stamp);
-					last_register = temp_register;
+					auto argument = generator.next_register();
+					generator.append<Load>(argument, generator.resolve(Symbol::intern(children[i]->token.value)));
+					arguments.push_back(argument);
 				} else {
-					std::optional<Register> stamp = children[i]->generate_bytecode(generator);
-					auto temp_register = generator.next_register();
-					generator.append<Send>(temp_register, last_register, "pass_param", stamp);
-					last_register = temp_register;
+					arguments.push_back(*children[i]->generate_bytecode(generator));
 				}
 			}
-			std::optional<Register> stamp = {};
-			auto call_result = generator.next_register();
-			generator.append<Send>(call_result, last_register, "call", stamp);
 			auto final = generator.next_register();
-			generator.add_basic_block();
-			generator.append<Send>(final, call_result, "get_return_value", stamp);
+			generator.append<Call>(final, callee, std::move(arguments));
 			return final;
 		}
 		case Token::Return: {
-			for (int i = generator.get_num_scopes() - 1; i >= 0; i--) {
-				auto lscope = generator.get_scope(i);
-				if (lscope->can_return) {
-					auto child_register = children[0]->generate_bytecode(generator);
-					generator.append<JumpSaved>(child_register);
-					generator.add_basic_block();
-					return child_register;
-				}
-			}
-			terminating_error(StampError::BytecodeGenerationError, token.position() + ": return used outside of function.");
-			break;
+			if (!generator.find_open_scope(&LexicalScope::can_return))
+				terminating_error(StampError::BytecodeGenerationError, token.position() + ": return used outside of function.");
+			auto child_register = children[0]->generate_bytecode(generator);
+			// the returned call is the last instruction generated for it
+			if (children[0]->token.type == Token::FnCall)
+				static_cast<Call*>(generator.last_instruction())->set_tail_call();
+			generator.append<Return>(child_register);
+			generator.add_basic_block();
+			return child_register;
 		}
 		case Token::If: {
 			auto condition = children[0]->generate_bytecode(generator);
 			auto ji = generator.append<JumpFalse>(*condition);
 			auto true_condition = children[1]->generate_bytecode(generator);
 			if (children.size() == 3) {
-				ji->set_jump(generator.get_num_bbs());
+				auto skip_else = generator.append<Jump>(0);
+				ji->set_jump(generator.add_basic_block()->get_index());
 				children[2]->generate_bytecode(generator);
+				skip_else->set_jump(generator.add_basic_block()->get_index());
 			} else {
 				ji->set_jump(generator.add_basic_block()->get_index());
 			}
@@ -141,38 +145,31 @@ std::optional<Register> ASTNode::generate_bytecode(Generator &generator) {
 			return body;
 		}
 		case Token::Break: {
-			for (int i = generator.get_num_scopes() - 1; i >= 0; i--) {
-				auto lscope = generator.get_scope(i);
-				if (lscope->can_break) {
-					lscope->add_pending_break(generator.append<Jump>(0));
-					return {};
-				}
-			}
-			terminating_error(StampError::BytecodeGenerationError, token.position() + ": break used outside of statement that can break.");
-			break;
+			auto lscope = generator.find_open_scope(&LexicalScope::can_break);
+			if (!lscope)
+				terminating_error(StampError::BytecodeGenerationError, token.position() + ": break used outside of statement that can break.");
+			lscope->add_pending_break(generator.append<Jump>(0));
+			return {};
 		}
 		case Token::Continue: {
-			for (int i = generator.get_num_scopes() - 1; i >= 0; i--) {
-				auto lscope = generator.get_scope(i);
-				if (lscope->can_continue) {
-					generator.append<Jump>(lscope->get_continue_dest());
-				}
-			}
-			terminating_error(StampError::BytecodeGenerationError, token.position() + ": continue used outside of statement that can break.");
-			break;
+			auto lscope = generator.find_open_scope(&LexicalScope::can_continue);
+			if (!lscope)
+				terminating_error(StampError::BytecodeGenerationError, token.position() + ": continue used outside of statement that can continue.");
+			generator.append<Jump>(lscope->get_continue_dest());
+			return {};
 		}
 		case Token::Vec: {
 			auto vec = generator.next_register();
-			generator.append<Load>(vec, "Vec");
+			generator.append<Load>(vec, Symbols::Vec);
 
-			std::optional<std::string> clone_stamp = "::lit_vec";
+			std::optional<Symbol> clone_stamp = Symbol::intern("::lit_vec");
 			auto dst = generator.next_register();
-			generator.append<Send>(dst, vec, "clone", clone_stamp);
+			generator.append<Send>(dst, vec, Symbols::clone, clone_stamp);
 
 			for (auto val : children) {
 				auto val_reg = val->generate_bytecode(generator);
 				auto temp = generator.next_register();
-				generator.append<Send>(temp, dst, "push", val_reg);
+				generator.append<Send>(temp, dst, Symbols::push, val_reg);
 				dst = temp;
 			}
 
@@ -188,36 +185,31 @@ std::optional<Register> ASTNode::generate_bytecode(Generator &generator) {
 				terminating_error(StampError::BytecodeGenerationError, token.position() + ": attempted to store not an object.");
 			}
 			bool is_mutable = children.size() == 4 && children[3]->token.type == Token::Mut;
-			generator.append<Store>(*obj, children[1]->token.value, *rhs, is_mutable);
+			generator.append<Store>(*obj, Symbol::intern(children[1]->token.value), *rhs, is_mutable);
 			return {};
 		}
 		case Token::Send: {
-			auto obj = children[0]->generate_bytecode(generator);
-			if (!obj.has_value()) {
-				terminating_error(StampError::BytecodeGenerationError, token.position() + ": attempted to send to not an Object.");
-			}
-			if (children[1]->children.size() != 0) {
-				if (children[1]->get_children()[0]->token.type == Token::Object || children[1]->get_children()[0]->token.type == Token::Value) {
-					std::optional<std::string> stamp = children[1]->get_children()[0]->token.value;
-					auto dst = generator.next_register();
-					generator.append<Send>(dst, *obj, children[1]->token.value, stamp);
-					return dst;
-				} else {
-					std::optional<Register> stamp = children[1]->get_children()[0]->generate_bytecode(generator);
-					auto dst = generator.next_register();
-					generator.append<Send>(dst, *obj, children[1]->token.value, stamp);
-					return dst;
+			// a chain of messages nests each send in the first child of the next one, the sends are generated from the
+			// innermost out in a loop so that long chains take no stack
+			std::vector<ASTNode *> chain;
+			auto receiver = this;
+			for (; receiver->token.type == Token::Send; receiver = receiver->children[0])
+				chain.push_back(receiver);
+			auto obj = receiver->generate_bytecode(generator);
+			for (auto send = chain.rbegin(); send != chain.rend(); send++) {
+				if (!obj.has_value()) {
+					terminating_error(StampError::BytecodeGenerationError, (*send)->token.position() + ": attempted to send to not an Object.");
 				}
-			} else {
-				std::optional<Register> stamp = {};
-				auto dst = generator.next_register();
-				generator.append<Send>(dst, *obj, children[1]->token.value, stamp);
-				return dst;
+				obj = (*send)->generate_send(generator, *obj);
 			}
+			return obj;
 		}
+		case Token::Use:
+			generator.use_module(std::string(token.value));
+			return {};
 		case Token::Object: {
 			auto dst = generator.next_register();
-			generator.append<Load>(dst, token.value);
+			generator.append<Load>(dst, generator.resolve(Symbol::intern(token.value)));
 			return dst;
 		}
 		ENUMERATE_BASIC_OBJECTS(__GENERATE_BASIC_OBJECT)
@@ -237,4 +229,37 @@ std::string ASTNode::to_string_indent(std::string indent) {
 		s << c->to_string_indent(indent + "  ");
 	}
 	return s.str();
-}
\ No newline at end of file
+}
+
+// sends the message of a Send node to obj
+Register ASTNode::generate_send(Generator &generator, Register obj) {
+	auto message = Symbol::intern(children[1]->token.value);
+	if (children[1]->children.size() != 0) {
+		auto name = Symbol::intern(children[1]->get_children()[0]->token.value);
+		bool is_name = children[1]->get_children()[0]->token.type == Token::Object || children[1]->get_children()[0]->token.type == Token::Value;
+		if (is_name && (message == Symbols::clone || message == Symbols::clone_callable)) {
+			// the clone is bound to the name it is stamped with
+			std::optional<Symbol> stamp = name;
+			auto dst = generator.next_register();
+			generator.append<Send>(dst, obj, message, stamp);
+			generator.append<Bind>(generator.declare(name), dst);
+			return dst;
+		} else if (is_name) {
+			std::optional<Register> stamp = generator.next_register();
+			generator.append<Load>(*stamp, generator.resolve(name));
+			auto dst = generator.next_register();
+			generator.append<Send>(dst, obj, message, stamp);
+			return dst;
+		} else {
+			std::optional<Register> stamp = children[1]->get_children()[0]->generate_bytecode(generator);
+			auto dst = generator.next_register();
+			generator.append<Send>(dst, obj, message, stamp);
+			return dst;
+		}
+	} else {
+		std::optional<Register> stamp = {};
+		auto dst = generator.next_register();
+		generator.append<Send>(dst, obj, message, stamp);
+		return dst;
+	}
+}
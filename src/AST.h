@@ -18,9 +18,9 @@
 class Context;
 
 #define ENUMERATE_BASIC_OBJECTS(O)\
-	O(Token::Int, "Int")                \
-	O(Token::Char, "Char")              \
-	O(Token::String, "String")
+	O(Token::Int, Symbols::Int)         \
+	O(Token::Char, Symbols::Char)       \
+	O(Token::String, Symbols::String)
 
 class ASTNode {
 public:
@@ -45,4 +45,5 @@ private:
 	std::vector<ASTNode *> children;
 
 	std::string to_string_indent(std::string indent);
+	Register generate_send(Generator &generator, Register obj);
 };
\ No newline at end of file
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+
+#include "Arena.h"
+
+void *Arena::allocate(size_t size, size_t alignment) {
+	auto aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(alignment - 1));
+	if (!current || aligned + size > end) {
+		// oversized requests get a chunk of their own
+		auto chunk_size = std::max(CHUNK_SIZE, size + alignment);
+		auto chunk = static_cast<uint8_t*>(::operator new(chunk_size));
+		chunks.push_back(chunk);
+		current = chunk;
+		end = chunk + chunk_size;
+		aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(alignment - 1));
+	}
+	current = aligned + size;
+	return aligned;
+}
+
+void Arena::clear() {
+	for (auto destructor = destructors.rbegin(); destructor != destructors.rend(); destructor++)
+		destructor->destroy(destructor->object);
+	destructors.clear();
+	for (auto chunk : chunks)
+		::operator delete(chunk);
+	chunks.clear();
+	current = nullptr;
+	end = nullptr;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for data that dies all at once, such as the AST of a compilation or the bytecode of a Generator.
+// Memory is carved out of large chunks and only released, after running the destructors, by clear() or ~Arena().
+class Arena {
+public:
+	Arena() {}
+	Arena(Arena const &) = delete;
+	Arena &operator=(Arena const &) = delete;
+	~Arena() { clear(); }
+
+	template<class T, typename... Args>
+	T *make(Args&&... args) {
+		auto object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr (!std::is_trivially_destructible_v<T>)
+			destructors.push_back({ object, [](void *pointer) { static_cast<T*>(pointer)->~T(); } });
+		return object;
+	}
+
+	void *allocate(size_t size, size_t alignment);
+	void clear();
+
+	size_t get_num_chunks() const { return chunks.size(); }
+private:
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	struct Destructor {
+		void *object;
+		void (*destroy)(void *);
+	};
+
+	std::vector<uint8_t*> chunks;
+	std::vector<Destructor> destructors;
+	uint8_t *current = { nullptr };
+	uint8_t *end = { nullptr };
+};
@@ -2,12 +2,6 @@
 
 #include "BasicBlock.h"
 
-BasicBlock::~BasicBlock() {
-	for (auto i : instructions) {
-		i->dealloc();
-	}
-}
-
 std::string BasicBlock::to_string() const {
 	std::string out;
 	for (auto i : instructions)
@@ -16,5 +10,8 @@ std::string BasicBlock::to_string() const {
 }
 
 void BasicBlock::dump() const {
-	std::cout << "BB" << std::to_string(index) << ":\n" << to_string() << "\n";
+	std::cout << "BB" << std::to_string(index) << ":";
+	for (auto scope : entered_scopes)
+		std::cout << " enters scope " << scope;
+	std::cout << "\n" << to_string() << "\n";
 }
\ No newline at end of file
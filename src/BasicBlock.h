@@ -17,7 +17,6 @@ class Instruction;
 class BasicBlock {
 public:
 	BasicBlock(uint32_t index) : index(index) {}
-	~BasicBlock();
 
 	std::string to_string() const;
 	void dump() const;
@@ -26,8 +25,14 @@ public:
 	std::vector<Instruction*> &get_instructions() { return instructions; }
 
 	void add_instruction(Instruction *instruction) { instructions.push_back(instruction); }
+
+	// scopes beginning with the block, precomputed so that entering a block never searches the scopes
+	std::vector<uint32_t> const &get_entered_scopes() const { return entered_scopes; }
+	void add_entered_scope(uint32_t scope_index) { entered_scopes.push_back(scope_index); }
 private:
 	uint32_t index;
 
+	std::vector<uint32_t> entered_scopes;
+
 	std::vector<Instruction*> instructions;
 };
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Bytecode.h"
+#include "Generator.h"
+#include "Error.h"
+
+// Blocks are only ever added after code was assembled, so the code of the blocks assembled before stays as it is and
+// the new blocks are appended to it. Code that is run again and again, like the snippets run by a VM, then only costs
+// the assembly of the new code.
+void Bytecode::assemble(Generator &generator) {
+	if (num_assembled_blocks > generator.get_num_bbs()) {
+		code.clear();
+		block_offsets.clear();
+		block_target_fixups.clear();
+		symbols.clear();
+		symbol_indices.clear();
+		inline_caches.clear();
+		threaded_code.clear();
+		functions.clear();
+		num_assembled_blocks = 0;
+		num_patched_fixups = 0;
+		num_threaded_fixups = 0;
+	}
+	// the end of the code is where the new blocks begin
+	if (!block_offsets.empty())
+		block_offsets.pop_back();
+
+	for (auto bb_index = num_assembled_blocks; bb_index < generator.get_num_bbs(); bb_index++) {
+		auto bb = generator.get_bbs()[bb_index];
+		while (!functions.empty() && functions.back()->get_end() < (int32_t)bb->get_index())
+			functions.pop_back();
+
+		block_offsets.push_back(code.size());
+		bool enters_function = false;
+		for (auto scope : bb->get_entered_scopes())
+			enters_function = enters_function || generator.get_scope(scope)->can_return;
+		// execution passes straight through empty blocks, e.g. blocks emptied by the optimizer
+		if (bb->get_instructions().empty() && !enters_function)
+			continue;
+
+		emit(Opcode::EnterBlock, { bb->get_index() });
+		for (auto scope : bb->get_entered_scopes()) {
+			auto function = generator.get_scope(scope);
+			if (function->can_return) {
+				functions.push_back(function);
+				emit(Opcode::EnterFrame, { scope, function->num_slots + function->num_registers + 1 });
+			}
+		}
+		register_base = functions.empty() ? 0 : functions.back()->first_register;
+		for (auto instruction : bb->get_instructions())
+			instruction->assemble(*this);
+		emit(Opcode::ExitBlock, { bb->get_index() });
+	}
+	block_offsets.push_back(code.size());
+	register_base = 0;
+
+	for (; num_patched_fixups < block_target_fixups.size(); num_patched_fixups++) {
+		auto fixup = block_target_fixups[num_patched_fixups];
+		if (code[fixup] >= block_offsets.size())
+			terminating_error(StampError::ExecutionError, "Jump to nonexistent basic block " + std::to_string(code[fixup]) + ".");
+		code[fixup] = block_offsets[code[fixup]];
+	}
+	num_assembled_blocks = generator.get_num_bbs();
+}
+
+bool Bytecode::is_assembled_from(Generator const &generator) const {
+	return !block_offsets.empty() && num_assembled_blocks == generator.get_num_bbs();
+}
+
+void Bytecode::emit(Opcode opcode, std::initializer_list<uint32_t> operands) {
+	code.push_back(static_cast<uint32_t>(opcode));
+	code.insert(code.end(), operands);
+}
+
+void Bytecode::emit_jump(Opcode opcode, uint32_t block, std::initializer_list<uint32_t> operands) {
+	code.push_back(static_cast<uint32_t>(opcode));
+	block_target_fixups.push_back(code.size());
+	code.push_back(block);
+	code.insert(code.end(), operands);
+}
+
+uint32_t Bytecode::add_symbol(Symbol symbol) {
+	auto index = symbol_indices.find(symbol);
+	if (index != symbol_indices.end())
+		return index->second;
+	symbols.push_back(symbol);
+	symbol_indices[symbol] = symbols.size() - 1;
+	return symbols.size() - 1;
+}
+
+uint32_t Bytecode::add_global(Symbol name) {
+	auto slot = global_slots.find(name);
+	if (slot != global_slots.end())
+		return slot->second;
+	global_names.push_back(name);
+	global_slots[name] = global_names.size() - 1;
+	return global_names.size() - 1;
+}
+
+std::optional<uint32_t> Bytecode::find_global(Symbol name) const {
+	auto slot = global_slots.find(name);
+	if (slot == global_slots.end())
+		return std::nullopt;
+	return slot->second;
+}
+
+uint32_t Bytecode::add_inline_cache() {
+	inline_caches.emplace_back();
+	return inline_caches.size() - 1;
+}
+
+void Bytecode::thread(void const *const *handlers, void const *end_handler) {
+	// only the code assembled since the last call is threaded, in place of the end handler
+	auto first = threaded_code.empty() ? 0 : threaded_code.size() - 1;
+	auto old_data = threaded_code.data();
+	threaded_code.resize(code.size() + 1);
+	for (auto pc = first; pc < code.size(); pc += num_operands(static_cast<Opcode>(code[pc])) + 1) {
+		threaded_code[pc] = handlers[code[pc]];
+		for (uint32_t i = 1; i <= num_operands(static_cast<Opcode>(code[pc])); i++)
+			threaded_code[pc + i] = reinterpret_cast<void const*>(static_cast<uintptr_t>(code[pc + i]));
+	}
+	threaded_code[code.size()] = end_handler;
+	// jump targets are already code offsets, the threaded code has the same layout; all of them move with the code
+	if (threaded_code.data() != old_data)
+		num_threaded_fixups = 0;
+	for (; num_threaded_fixups < block_target_fixups.size(); num_threaded_fixups++) {
+		auto fixup = block_target_fixups[num_threaded_fixups];
+		threaded_code[fixup] = &threaded_code[code[fixup]];
+	}
+}
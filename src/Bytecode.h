@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Register.h"
+#include "Symbol.h"
+#include "InlineCache.h"
+
+class Generator;
+class LexicalScope;
+
+// opcode, number of operand words
+#define ENUMERATE_OPCODES(O) \
+	O(EnterBlock, 1)         \
+	O(ExitBlock, 1)          \
+	O(EnterFrame, 2)         \
+	O(LoadDefault, 1)        \
+	O(LoadConst, 2)          \
+	O(LoadGlobal, 2)         \
+	O(LoadLocal, 4)          \
+	O(BindGlobal, 2)         \
+	O(BindLocal, 3)          \
+	O(Send, 6)               \
+	O(Store, 4)              \
+	O(Jump, 1)               \
+	O(JumpTrue, 2)           \
+	O(JumpFalse, 2)          \
+	O(Arg, 1)                \
+	O(Call, 3)               \
+	O(TailCall, 3)           \
+	O(Return, 2)
+
+enum class Opcode : uint32_t {
+#define __OPCODES(op, n) \
+	op,
+	ENUMERATE_OPCODES(__OPCODES)
+#undef __OPCODES
+};
+
+// what the stamp operand word of a Send holds
+enum class StampKind : uint32_t {
+	None,
+	Register,
+	Symbol,
+	Block,
+};
+
+// Flat form of the generator's basic blocks, which is what the interpreter executes. Every instruction is an opcode
+// word followed by a fixed number of operand words. Symbols are indices into the symbol pool, constants are indices
+// into the generator's constant pool, inline caches are indices into a side table, globals are slots of the global
+// frame and jump targets are code offsets. Blocks are delimited by EnterBlock/ExitBlock. The first block of a
+// function is followed by EnterFrame, which sizes the frame of the function on top of the arguments pushed by Arg: its
+// slots, the registers left to it by the register allocator and a scratch register.
+// Registers of a function are numbered from the start of its frame's registers. A TailCall is a call whose result is
+// returned right away, so the called function's frame can replace the frame of the caller.
+//
+// Operands:
+//   EnterBlock/ExitBlock  block
+//   EnterFrame            function scope, frame size
+//   LoadDefault           dst
+//   LoadConst             dst, constant
+//   LoadGlobal            dst, global
+//   LoadLocal             dst, depth, slot, name symbol
+//   BindGlobal            global, src
+//   BindLocal             depth, slot, src
+//   Send                  dst, obj, message symbol, stamp kind, stamp, inline cache
+//   Store                 obj, store name symbol, store, is_mutable
+//   Jump                  target
+//   JumpTrue/JumpFalse    target, condition
+//   Arg                   src
+//   Call/TailCall         dst, function, number of arguments
+//   Return                has_retval, retval
+class Bytecode {
+public:
+	Bytecode() {}
+
+	void assemble(Generator &generator);
+	bool is_assembled_from(Generator const &generator) const;
+
+	void emit(Opcode opcode, std::initializer_list<uint32_t> operands);
+	// the target block is patched to its code offset once all blocks are laid out
+	void emit_jump(Opcode opcode, uint32_t block, std::initializer_list<uint32_t> operands);
+	uint32_t add_symbol(Symbol symbol);
+	uint32_t add_inline_cache();
+	// register operand relative to the registers of the function being assembled
+	uint32_t reg(Register reg) const { return reg.get_index() - register_base; }
+	// globals keep their slots when the code is reassembled since the global frame outlives it
+	uint32_t add_global(Symbol name);
+	std::optional<uint32_t> find_global(Symbol name) const;
+
+	// Builds the direct-threaded form of the code used by the computed-goto dispatcher, for the code assembled since it
+	// was last built. It has the same layout as the flat code, but opcode words are replaced by the address of their
+	// handler and jump targets by the address of the target instruction. The end of the code is a handler that leaves
+	// the dispatch loop.
+	void thread(void const *const *handlers, void const *end_handler);
+	bool is_threaded() const { return threaded_code.size() == code.size() + 1; }
+	void const *const *get_threaded_code() const { return threaded_code.data(); }
+
+	uint32_t const *get_code() const { return code.data(); }
+	uint32_t get_size() const { return code.size(); }
+	uint32_t block_offset(uint32_t block) const { return block_offsets[block]; }
+	Symbol symbol(uint32_t index) const { return symbols[index]; }
+	InlineCache &inline_cache(uint32_t index) { return inline_caches[index]; }
+	Symbol global_name(uint32_t slot) const { return global_names[slot]; }
+	uint32_t get_num_globals() const { return global_names.size(); }
+
+	static uint32_t num_operands(Opcode opcode) {
+		static constexpr uint32_t operand_counts[] = {
+#define __OPCODES(op, n) \
+			n,
+			ENUMERATE_OPCODES(__OPCODES)
+#undef __OPCODES
+		};
+		return operand_counts[static_cast<uint32_t>(opcode)];
+	}
+private:
+	std::vector<uint32_t> code;
+	// offset of every block, followed by the end of the code
+	std::vector<uint32_t> block_offsets;
+	std::vector<uint32_t> block_target_fixups;
+	std::vector<void const*> threaded_code;
+	std::vector<Symbol> symbols;
+	std::unordered_map<Symbol, uint32_t> symbol_indices;
+	std::vector<InlineCache> inline_caches;
+	std::vector<Symbol> global_names;
+	std::unordered_map<Symbol, uint32_t> global_slots;
+	uint32_t num_assembled_blocks = { 0 };
+	// jumps whose target block was replaced by its code offset, and whose target is set in the threaded code
+	uint32_t num_patched_fixups = { 0 };
+	uint32_t num_threaded_fixups = { 0 };
+	// functions whose blocks are being assembled, innermost last, kept for the blocks assembled next
+	std::vector<LexicalScope*> functions;
+	uint32_t register_base = { 0 };
+};
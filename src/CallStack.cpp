@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CallStack.h"
+#include "Error.h"
+
+void CallStack::push_argument(Value value) {
+	make_room(top - arguments_begin + 1);
+	segments[segment].values[top++] = std::move(value);
+}
+
+CallFrame &CallStack::push_call(uint32_t num_arguments, uint32_t return_pc, uint32_t return_register, bool is_tail_call) {
+	if (frames.size() >= max_depth)
+		terminating_error(StampError::ExecutionError, "Stack overflow: more than " + std::to_string(max_depth) + " nested calls.");
+
+	CallFrame frame;
+	frame.segment = segment;
+	frame.base = top - num_arguments;
+	frame.num_arguments = num_arguments;
+	frame.return_pc = return_pc;
+	frame.return_register = return_register;
+	frame.is_tail_call = is_tail_call;
+	frames.push_back(frame);
+	arguments_begin = frame.base;
+	return frames.back();
+}
+
+std::optional<Value> *CallStack::enter_frame(uint32_t size) {
+	make_room(size);
+	auto &frame = frames.back();
+	frame.segment = segment;
+	frame.base = arguments_begin;
+	frame.size = size;
+	top = arguments_begin = frame.base + size;
+	return values(frame);
+}
+
+void CallStack::replace_caller() {
+	auto call = frames.back();
+	frames.pop_back();
+	auto &caller = frames.back();
+
+	auto to = values(caller);
+	auto from = values(call);
+	if (call.segment != caller.segment && caller.base + call.num_arguments > segments[caller.segment].size) {
+		// the arguments do not fit where the caller begins, so the call stays in the next segment and the caller's
+		// values are dropped
+		for (uint32_t i = 0; i < caller.size; i++)
+			to[i].reset();
+		caller.segment = call.segment;
+		caller.base = call.base;
+	} else {
+		// the arguments are always above the caller's values, so moving them in order never overwrites one not yet
+		// moved
+		for (uint32_t i = 0; i < call.num_arguments; i++)
+			to[i] = std::move(from[i]);
+		if (call.segment == caller.segment) {
+			for (auto value = to + call.num_arguments; value < segments[segment].values.get() + top; value++)
+				value->reset();
+		} else {
+			for (uint32_t i = call.num_arguments; i < caller.size; i++)
+				to[i].reset();
+			for (uint32_t i = 0; i < call.num_arguments; i++)
+				from[i].reset();
+		}
+	}
+
+	// the call returns to where its caller would have returned
+	caller.function = nullptr;
+	caller.parent = -1;
+	caller.size = 0;
+	caller.num_arguments = call.num_arguments;
+	caller.is_tail_call = false;
+	segment = caller.segment;
+	arguments_begin = caller.base;
+	top = caller.base + call.num_arguments;
+}
+
+CallFrame CallStack::pop_call() {
+	auto frame = frames.back();
+	frames.pop_back();
+	auto frame_values = values(frame);
+	for (uint32_t i = 0; i < frame.size; i++)
+		frame_values[i].reset();
+
+	if (frames.empty()) {
+		segment = 0;
+		top = 0;
+	} else {
+		segment = frames.back().segment;
+		top = frames.back().base + frames.back().size;
+	}
+	arguments_begin = top;
+	// keep one segment above the current one so that calls at a segment boundary do not reallocate it every time
+	if (segments.size() > segment + 2)
+		segments.resize(segment + 2);
+	return frame;
+}
+
+void CallStack::clear() {
+	frames.clear();
+	segments.clear();
+	segment = 0;
+	top = 0;
+	arguments_begin = 0;
+}
+
+void CallStack::make_room(uint32_t size) {
+	if (segment < segments.size() && arguments_begin + size <= segments[segment].size)
+		return;
+
+	// the current segment is only missing before anything was pushed
+	auto next = segment < segments.size() ? segment + 1 : segment;
+	if (next == segments.size())
+		segments.push_back({ nullptr, 0 });
+	// segments above the current one are empty, so a segment that is too small can be replaced
+	if (segments[next].size < size) {
+		auto next_size = size > SEGMENT_SIZE ? size : SEGMENT_SIZE;
+		segments[next] = { std::make_unique<std::optional<Value>[]>(next_size), next_size };
+	}
+
+	if (next != segment) {
+		auto from = segments[segment].values.get();
+		auto to = segments[next].values.get();
+		for (uint32_t i = arguments_begin; i < top; i++) {
+			to[i - arguments_begin] = std::move(from[i]);
+			from[i].reset();
+		}
+		segment = next;
+		top -= arguments_begin;
+		arguments_begin = 0;
+	}
+}
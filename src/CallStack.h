@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Object.h"
+
+class LexicalScope;
+
+// A function being executed. Its arguments, the rest of its variables and its registers follow each other in one
+// segment of the call stack.
+struct CallFrame {
+	LexicalScope *function = { nullptr };
+	// the frame of the enclosing function, -1 for functions declared outside of functions
+	int32_t parent = { -1 };
+	// segment and offset of the first value of the frame, and the number of values once the function is known
+	uint32_t segment = { 0 };
+	uint32_t base = { 0 };
+	uint32_t size = { 0 };
+	uint32_t num_arguments = { 0 };
+	uint32_t return_pc = { 0 };
+	// register of the caller that receives the return value
+	uint32_t return_register = { 0 };
+	// made by a return of a call, so the frame may replace the frame of its caller
+	bool is_tail_call = { false };
+};
+
+// Frames of the functions being executed. Values live in fixed-size segments that are allocated as the calls get
+// deeper, so growing the stack never moves the frames below and deep recursion only costs heap memory. A frame never
+// spans two segments; arguments are moved to the next segment when the frame does not fit after them. Values above
+// the innermost frame are always empty.
+class CallStack {
+public:
+	static constexpr uint32_t DEFAULT_MAX_DEPTH = 10000;
+
+	CallStack() {}
+	CallStack(CallStack const &) = delete;
+	CallStack &operator=(CallStack const &) = delete;
+
+	void set_max_depth(uint32_t depth) { max_depth = depth; }
+	uint32_t get_max_depth() const { return max_depth; }
+
+	bool empty() const { return frames.empty(); }
+	uint32_t size() const { return frames.size(); }
+	CallFrame &back() { return frames.back(); }
+	CallFrame &operator[](uint32_t index) { return frames[index]; }
+
+	// first value of a frame, its arguments come first
+	std::optional<Value> *values(CallFrame const &frame) { return segments[frame.segment].values.get() + frame.base; }
+
+	// arguments are pushed above the innermost frame before the call is made
+	void push_argument(Value value);
+	// starts a call taking the last num_arguments pushed arguments, fails with a stack overflow past the maximum depth
+	CallFrame &push_call(uint32_t num_arguments, uint32_t return_pc, uint32_t return_register, bool is_tail_call);
+	// allocates the values of the innermost call once its function is known
+	std::optional<Value> *enter_frame(uint32_t size);
+	// moves the arguments of the innermost call over the frame of its caller, which it replaces
+	void replace_caller();
+	CallFrame pop_call();
+	// drops every frame and pending argument, e.g. when the code making the calls failed
+	void clear();
+
+	template<typename Callback>
+	void for_each_value(Callback callback) {
+		for (uint32_t i = 0; i < segments.size() && i <= segment; i++) {
+			for (uint32_t j = 0; j < segments[i].size; j++) {
+				if (segments[i].values[j])
+					callback(*segments[i].values[j]);
+			}
+		}
+	}
+
+	size_t get_num_segments() const { return segments.size(); }
+private:
+	// large enough for most frames, bigger frames get a segment of their own
+	static constexpr uint32_t SEGMENT_SIZE = 16 * 1024;
+
+	struct Segment {
+		std::unique_ptr<std::optional<Value>[]> values;
+		uint32_t size;
+	};
+
+	// makes room for size values from where the pending arguments begin, moving them to the start of the next
+	// segment if they do not fit in the current one
+	void make_room(uint32_t size);
+
+	std::vector<Segment> segments;
+	std::vector<CallFrame> frames;
+	// end of the used values in the current segment, and where the pending arguments of the next call begin
+	uint32_t segment = { 0 };
+	uint32_t top = { 0 };
+	uint32_t arguments_begin = { 0 };
+	uint32_t max_depth = { DEFAULT_MAX_DEPTH };
+};
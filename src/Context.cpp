@@ -5,39 +5,24 @@
  */
 
 #include <iostream>
-#include <set>
 #include <string>
 
 #include "Context.h"
 
-void Context::add(std::string name, Object *object) {
-	context[name] = object;
-}
-
-Object *Context::get(std::string &name) {
-	if (context.count(name))
-		return context[name];
-	return nullptr;
-}
-
 void Context::dump() {
 	std::cout << "----------------------\nContext:\n";
-	for (auto const& c : context) {
-		std::cout << c.first << " = " << c.second->to_string();
+	for (uint32_t i = 0; i < slots.size(); i++) {
+		if (slots[i])
+			std::cout << i << " = " << slots[i]->to_string();
 	}
 	std::cout << "----------------------\n";
 }
 
-Context *Context::make_global_context() {
-	static Context *global_context = new Context();
-
-	// Object
-	auto object = new Object(nullptr, "Object");
-	object->add_store<StoreLiteral>("type", "Object", false);
-	std::set<std::string> object_stores = {"clone", "==", "!="};
-	object->add_default_stores(object_stores);
-
-	global_context->add("Object", object);
-
-	return global_context;
+Object *Context::make_object_prototype() {
+	auto object = Heap::the().allocate<Object>(nullptr, Symbols::Object);
+	object->add_store<StoreLiteral>(Symbols::type, "Object", false);
+	object->add_default_store(Symbols::clone);
+	object->add_default_store(Symbols::equals);
+	object->add_default_store(Symbols::nequals);
+	return object;
 }
\ No newline at end of file
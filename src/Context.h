@@ -6,21 +6,33 @@
 
 #pragma once
 
-#include <map>
-#include <string>
+#include <vector>
 
 #include "Object.h"
 
-class Context {
+// Global variables of the program. The generator resolves variables to slots, so the frame is only an array;
+// variables of functions live on the interpreter's stack instead.
+class Context : public Cell {
 public:
-	Context() {}
+	Context(uint32_t num_slots) : slots(num_slots, nullptr) {}
+
+	Object *get(uint32_t slot) const { return slots[slot]; }
+	void set(uint32_t slot, Object *object) { slots[slot] = object; }
+	// the global frame grows as more code is assembled
+	void resize(uint32_t num_slots) {
+		if (slots.size() < num_slots)
+			slots.resize(num_slots, nullptr);
+	}
+	size_t size() const { return slots.size(); }
 
-	// FIXME: maybe error when name is taken?
-	void add(std::string name, Object *object);
-	Object *get(std::string &name);
 	void dump();
 
-	static Context *make_global_context();
+	void visit_edges(Heap &heap) override {
+		for (auto object : slots)
+			heap.mark(object);
+	}
+
+	static Object *make_object_prototype();
 private:
-	std::map<std::string, Object*> context;
-};
\ No newline at end of file
+	std::vector<Object*> slots;
+};
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <charconv>
 #include <map>
 #include <string>
 #include <variant>
@@ -17,86 +18,174 @@
 #include "Interpreter.h"
 #include "Error.h"
 
-#define int_arithmetic(op) \
-	auto result = static_cast<StoreInt*>(object->get_store("value"))->unwrap() op static_cast<StoreInt*>(other->get_store("value"))->unwrap(); \
-	auto result_obj = std::get<Object*>(clone_object(object->get_prototype(), "::lit_" + std::to_string(result), interpreter)); \
-	result_obj->add_store<StoreInt>("value", result, true); \
-	return result_obj;
-
-#define int_compare(op) \
-	auto result = static_cast<StoreInt*>(object->get_store("value"))->unwrap() op static_cast<StoreInt*>(other->get_store("value"))->unwrap(); \
-	return result ? interpreter.fetch_global_object("True") : interpreter.fetch_global_object("False");
-
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> clone_object(Object *original, std::optional<std::variant<Register, std::string, uint32_t>> name, Interpreter&interpreter) {
-	std::string new_type = std::get<std::string>(*name);
-	if (std::isupper(new_type[0])) {
-		Object *cloned = new Object(original, new_type);
-		std::set<std::string> default_stores = { "clone" };
-		cloned->add_default_stores(default_stores);
-		interpreter.put_object(new_type, cloned);
-		return cloned;
-	} else {
-		Object *cloned = new Object(original, original->get_type());
-		interpreter.put_object(new_type, cloned);
-		return cloned;
+// What a default store was sent with. Scripts can send any default store with anything, so a stamp of another kind
+// is an error of the script.
+template<typename T>
+T const &stamp_of(std::optional<std::variant<Register, Symbol, uint32_t>> const &stamp, char const *expected) {
+	auto value = stamp ? std::get_if<T>(&*stamp) : nullptr;
+	if (!value)
+		terminating_error(StampError::DefaultStoreError, std::string("Default store expected ") + expected + ".");
+	return *value;
+}
+
+// Ints reach default stores either unboxed or as Int objects.
+std::optional<int32_t> int_of(Value const &value) {
+	if (auto integer = std::get_if<int32_t>(&value))
+		return *integer;
+	// clones of Ints have types of their own and the value of the Int they were cloned from
+	auto object = std::get_if<Object*>(&value);
+	for (auto holder = object ? *object : nullptr; holder; holder = holder->get_prototype()) {
+		if (auto store = holder->get_store(Symbols::value)) {
+			if (store->get_type() == InternalStore::Type::StoreInt)
+				return static_cast<StoreInt*>(store)->unwrap();
+			return std::nullopt;
+		}
 	}
+	return std::nullopt;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> object_equals(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	Object *other;
-	if (std::get_if<Register>(&*stamp))
-		other = *std::get_if<Object*>(&interpreter.at(std::get<Register>(*stamp).get_index()));
-	else
-		other = interpreter.fetch_object(std::get<std::string>(*stamp));
+Symbol type_of(Value const &value) {
+	if (auto object = std::get_if<Object*>(&value))
+		return *object ? (*object)->get_type() : Symbols::Object;
+	if (std::holds_alternative<int32_t>(value))
+		return Symbols::Int;
+	if (std::holds_alternative<std::string>(value))
+		return Symbols::String;
+	return Symbols::Vec;
+}
 
-	if (object->get_type() == "Int") {
-		int_compare(==)
-	} else {
-		if (object->get_hash() == other->get_hash())
-			return interpreter.fetch_global_object("True");
-		else
-			return interpreter.fetch_global_object("False");
+Value boolean(bool value, Interpreter &interpreter) {
+	return value ? interpreter.true_object() : interpreter.false_object();
+}
+
+// Int default stores that can be computed without an Int object; nothing is returned for any other message. Results
+// that do not fit into an Int are errors, as is division by zero.
+std::optional<Value> int_operation(Symbol message, int32_t lhs, int32_t rhs, Interpreter &interpreter) {
+	int64_t result;
+	switch (static_cast<WellKnownSymbol>(message.get_id())) {
+		case WellKnownSymbol::mod:
+		case WellKnownSymbol::div:
+			if (rhs == 0) {
+				terminating_error(StampError::DefaultStoreError, "Division by zero.");
+				return std::nullopt;
+			}
+			result = message == Symbols::mod ? (int64_t)lhs % rhs : (int64_t)lhs / rhs;
+			break;
+		case WellKnownSymbol::mul: result = (int64_t)lhs * rhs; break;
+		case WellKnownSymbol::add: result = (int64_t)lhs + rhs; break;
+		case WellKnownSymbol::sub: result = (int64_t)lhs - rhs; break;
+		case WellKnownSymbol::shl:
+		case WellKnownSymbol::shr:
+			if (rhs < 0 || rhs > 31) {
+				terminating_error(StampError::DefaultStoreError, "Shift by " + std::to_string(rhs) + " is out of range.");
+				return std::nullopt;
+			}
+			result = message == Symbols::shl ? (int64_t)lhs * ((int64_t)1 << rhs) : lhs >> rhs;
+			break;
+		case WellKnownSymbol::and_: return lhs & rhs;
+		case WellKnownSymbol::xor_: return lhs ^ rhs;
+		case WellKnownSymbol::or_: return lhs | rhs;
+		case WellKnownSymbol::lt: return boolean(lhs < rhs, interpreter);
+		case WellKnownSymbol::le: return boolean(lhs <= rhs, interpreter);
+		case WellKnownSymbol::gt: return boolean(lhs > rhs, interpreter);
+		case WellKnownSymbol::ge: return boolean(lhs >= rhs, interpreter);
+		case WellKnownSymbol::equals: return boolean(lhs == rhs, interpreter);
+		case WellKnownSymbol::nequals: return boolean(lhs != rhs, interpreter);
+		default: return std::nullopt;
+	}
+	if (result < INT32_MIN || result > INT32_MAX) {
+		terminating_error(StampError::DefaultStoreError, "Int overflow in " + std::to_string(lhs) + " " + message.str() + " "
+			+ std::to_string(rhs) + ".");
+		return std::nullopt;
 	}
+	return static_cast<int32_t>(result);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> object_nequals(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	Object *other;
-	if (std::get_if<Register>(&*stamp))
-		other = *std::get_if<Object*>(&interpreter.at(std::get<Register>(*stamp).get_index()));
-	else
-		other = interpreter.fetch_object(std::get<std::string>(*stamp));
+Value int_binary_operation(Symbol message, Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	auto &other = interpreter.at(stamp_of<Register>(stamp, "a value").get_index());
+	auto lhs = int_of(object);
+	auto rhs = int_of(other);
+	if (lhs && rhs)
+		return *int_operation(message, *lhs, *rhs, interpreter);
+	terminating_error(StampError::DefaultStoreError, message.str() + " default store not implemented for " + object->get_type().str() + " and " + type_of(other).str() + ".");
+	Object *error = nullptr;
+	return error;
+}
+
+// Clones used internally (literals, parameter bookkeeping) do not get a type of their own.
+Object *clone_anonymous(Object *original) {
+	return Heap::the().allocate<Object>(original, original->get_type());
+}
 
-	if (object->get_type() == "Int") {
-		int_compare(!=)
+// the generator binds the clone to its name
+Value clone_object(Object *original, std::optional<std::variant<Register, Symbol, uint32_t>> name, Interpreter &) {
+	Symbol new_type = stamp_of<Symbol>(name, "a name");
+	if (new_type.is_internal()) {
+		return clone_anonymous(original);
+	} else if (std::isupper(new_type.str()[0])) {
+		Object *cloned = Heap::the().allocate<Object>(original, new_type);
+		cloned->add_default_store(Symbols::clone);
+		return cloned;
 	} else {
-		if (object->get_hash() == other->get_hash())
-			return interpreter.fetch_global_object("False");
-		else
-			return interpreter.fetch_global_object("True");
+		return Heap::the().allocate<Object>(original, original->get_type());
 	}
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> store_value(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> _stamp, Interpreter &) {
-	auto stamp = std::get<std::string>(*_stamp);
-	if (object->get_type() == "Int") {
-		object->add_store<StoreInt>("value", std::stoi(stamp), true);
-	} else if (object->get_type() == "Char") {
-		object->add_store<StoreChar>("value", stamp[0], true);
-	} else if (object->get_type() == "String") {
-		object->add_store<StoreLiteral>("value", stamp, true);
+Value object_equals(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	Value other;
+	if (stamp && std::holds_alternative<Register>(*stamp))
+		other = interpreter.at(std::get<Register>(*stamp).get_index());
+	else
+		other = interpreter.fetch_global_object(stamp_of<Symbol>(stamp, "a value"));
+
+	auto lhs = int_of(object);
+	auto rhs = int_of(other);
+	if (lhs && rhs)
+		return boolean(*lhs == *rhs, interpreter);
+	auto other_object = std::get_if<Object*>(&other);
+	return boolean(other_object && *other_object && object->get_hash() == (*other_object)->get_hash(), interpreter);
+}
+
+Value object_nequals(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	auto equals = object_equals(object, stamp, interpreter);
+	return boolean(std::get<Object*>(equals) == interpreter.false_object(), interpreter);
+}
+
+Value store_value(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> _stamp, Interpreter &) {
+	auto &stamp = stamp_of<Symbol>(_stamp, "a literal").str();
+	if (object->get_type() == Symbols::Int) {
+		int32_t value;
+		auto [end, error] = std::from_chars(stamp.data(), stamp.data() + stamp.size(), value);
+		if (error != std::errc() || end != stamp.data() + stamp.size())
+			terminating_error(StampError::DefaultStoreError, "Int literal " + stamp + " does not fit into an Int.");
+		object->add_store<StoreInt>(Symbols::value, value, true);
+	} else if (object->get_type() == Symbols::Char) {
+		object->add_store<StoreChar>(Symbols::value, stamp[0], true);
+	} else if (object->get_type() == Symbols::String) {
+		object->add_store<StoreLiteral>(Symbols::value, stamp, true);
 	} else {
-		terminating_error(StampError::DefaultStoreError, "store_value is not implemented for " + object->get_type());
+		terminating_error(StampError::DefaultStoreError, "store_value is not implemented for " + object->get_type().str());
 	}
 	return object;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> get(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
+Value get(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
 	// FIXME: maybe move to start of interpreter (or something similar), otherwise will have to add to all Vec functions
-	if (!object->get_store("value")) {
-		object->add_store<StoreVec>("value", new std::vector<InternalStore*>(), true);
+	if (!object->get_store(Symbols::value)) {
+		object->add_store<StoreVec>(Symbols::value, Heap::the().allocate<VecStorage>(), true);
 	}
-	auto index = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()))->send("value", std::nullopt, nullptr, interpreter);
-	auto value = (static_cast<StoreVec*>(object->get_store("value")))->unwrap()->at(std::get<int32_t>(index));
+	auto index = int_of(interpreter.at(stamp_of<Register>(stamp, "a value").get_index()));
+	if (!index) {
+		terminating_error(StampError::DefaultStoreError, "Vec index is not an Int.");
+		Object *error = nullptr;
+		return error;
+	}
+	auto vec = static_cast<StoreVec*>(object->get_store(Symbols::value))->unwrap();
+	if (*index < 0 || static_cast<size_t>(*index) >= vec->size()) {
+		terminating_error(StampError::DefaultStoreError, "Vec index " + std::to_string(*index) + " is out of range for a Vec of size "
+			+ std::to_string(vec->size()) + ".");
+	}
+	auto value = (*vec)[*index];
 #define __UNWRAP_STORE(t, c) \
 		case InternalStore::Type::t: return static_cast<c*>(value)->unwrap();
 	switch(value->get_type()) {
@@ -110,263 +199,132 @@ std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> get(O
 #undef __UNWRAP_STORE
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> push(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto store = static_cast<InternalStore*>(new StoreObject(std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index())), true));
+Value push(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	auto &element = interpreter.at(stamp_of<Register>(stamp, "a value").get_index());
+	InternalStore *store;
+	if (auto integer = std::get_if<int32_t>(&element))
+		store = Heap::the().allocate<StoreInt>(*integer, true);
+	else
+		store = Heap::the().allocate<StoreObject>(interpreter.as_object(element), true);
 	// FIXME: maybe move to start of interpreter (or something similar), otherwise will have to add to all Vec functions
-	if (!object->get_store("value")) {
-		object->add_store<StoreVec>("value", new std::vector<InternalStore*>(), true);
+	if (!object->get_store(Symbols::value)) {
+		object->add_store<StoreVec>(Symbols::value, Heap::the().allocate<VecStorage>(), true);
 	}
-	(static_cast<StoreVec*>(object->get_store("value")))->unwrap()->push_back(store);
+	(static_cast<StoreVec*>(object->get_store(Symbols::value)))->unwrap()->push_back(store);
 	return object;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> clone_callable(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
+Value clone_callable(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
 	auto new_fn = std::get<Object*>(clone_object(object, stamp, interpreter));
 
-	std::set<std::string> ds = { "clone_callable" };
-	new_fn->add_default_stores(ds);
-	auto new_param_names = std::get<Object*>(clone_object(static_cast<StoreObject*>(object->get_store("param_names"))->unwrap(), "::param_names", interpreter));
-	new_fn->add_store<StoreObject>("param_names", new_param_names, true);
-	auto num_passed_params = std::get<Object*>(clone_object(interpreter.fetch_global_object("Int"), "::num_passed_params", interpreter));
-	store_value(num_passed_params, "0", interpreter);
-	new_fn->add_store<StoreObject>("num_passed_params", num_passed_params, true);
+	new_fn->add_default_store(Symbols::clone_callable);
+	auto new_param_names = clone_anonymous(static_cast<StoreObject*>(object->get_store(Symbols::param_names))->unwrap());
+	new_fn->add_store<StoreObject>(Symbols::param_names, new_param_names, true);
 
 	return new_fn;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> store_param(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto vec = static_cast<StoreObject*>(object->get_store("param_names"))->unwrap();
-	auto param = std::get<Object*>(clone_object(interpreter.fetch_global_object("String"), "::" + std::get<std::string>(*stamp), interpreter));
+Value store_param(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	auto vec = static_cast<StoreObject*>(object->get_store(Symbols::param_names))->unwrap();
+	auto param = clone_anonymous(interpreter.fetch_global_object(Symbols::String));
 	store_value(param, stamp, interpreter);
-	push(vec, interpreter.store_at_next_available(param), interpreter);
+	push(vec, interpreter.store_at_scratch(param), interpreter);
 	return object;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> pass_body(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &) {
-	object->add_store<StoreRegister>("body", std::get<uint32_t>(*stamp), false);
+Value pass_body(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &) {
+	object->add_store<StoreRegister>(Symbols::body, stamp_of<uint32_t>(stamp, "a function body"), false);
 	return object;
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> pass_param(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	uint32_t bb_index = static_cast<StoreRegister*>(object->get_store("body"))->unwrap();
-	Object *param;
-	if (std::holds_alternative<std::string>(*stamp))
-		param = interpreter.fetch_object(std::get<std::string>(*stamp));
-	else
-		param = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	auto num_passed_params_obj = static_cast<StoreObject*>(object->get_store("num_passed_params"))->unwrap();
-	auto param_names = static_cast<StoreObject*>(object->get_store("param_names"))->unwrap();
-	auto this_param_name_obj = std::get<Object*>(get(param_names, interpreter.store_at_next_available(num_passed_params_obj), interpreter));
-	auto this_param_name = std::get<std::string>(this_param_name_obj->send("value", std::nullopt, nullptr, interpreter));
-	interpreter.put_object_at_scope(this_param_name, param, bb_index);
-	// FIXME: change this when/if there is a better way to change the value
-	store_value(num_passed_params_obj, std::to_string(static_cast<StoreInt*>(num_passed_params_obj->get_store("value"))->unwrap() + 1), interpreter);
-	return object;
+Value mod(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::mod, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> call(Object *object, std::optional<std::variant<Register, std::string, uint32_t>>, Interpreter &interpreter) {
-	// FIXME: verify that number of passed params is the same as number of param names
-	uint32_t bb_index = static_cast<StoreRegister*>(object->get_store("body"))->unwrap();
-	interpreter.save_next_bb();
-	interpreter.jump_bb(bb_index);
-	return object;
+Value mul(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::mul, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> get_return_value(Object *, std::optional<std::variant<Register, std::string, uint32_t>>, Interpreter &interpreter) {
-	auto retval = interpreter.pop_retval();
-	if (retval)
-		return interpreter.at((*retval).get_index());
-	else {
-		Object *out = nullptr;
-		return out;
-	}
+Value divop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::div, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> mod(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(%)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "% default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value add(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::add, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> mul(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(*)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "* default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value sub(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::sub, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> divop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(/)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "/ default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value shl(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::shl, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> add(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(+)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "+ default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value shr(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::shr, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> sub(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(-)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "- default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value lop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::lt, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> shl(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(<<)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "<< default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value leop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::le, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> shr(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(>>)
-	} else {
-		terminating_error(StampError::DefaultStoreError, ">> default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value gop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::gt, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> lop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_compare(<)
-	} else {
-		terminating_error(StampError::DefaultStoreError, ">> default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value geop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::ge, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> leop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_compare(<=)
-	} else {
-		terminating_error(StampError::DefaultStoreError, ">> default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value andop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::and_, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> gop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_compare(>)
-	} else {
-		terminating_error(StampError::DefaultStoreError, ">> default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
-}
-
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> geop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_compare(>=)
-	} else {
-		terminating_error(StampError::DefaultStoreError, ">> default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value xorop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::xor_, object, stamp, interpreter);
 }
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> andop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(&)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "+ default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
-}
-
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> xorop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(^)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "+ default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
-}
-
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> orop(Object *object, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Interpreter &interpreter) {
-	auto other = std::get<Object *>(interpreter.at(std::get<Register>(*stamp).get_index()));
-	if (object->get_type() == "Int") {
-		int_arithmetic(|)
-	} else {
-		terminating_error(StampError::DefaultStoreError, "+ default store not implemented for " + object->get_type() + " and " + other->get_type() + ".");
-		Object *error = nullptr;
-		return error;
-	}
+Value orop(Object *object, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	return int_binary_operation(Symbols::or_, object, stamp, interpreter);
 }
 
 #define ENUMERATE_DEFAULT_STORES(DS) \
-	DS("clone", clone_object), \
-	DS("==", object_equals), \
-	DS("!=", object_nequals), \
-	DS("store_value", store_value), \
-	DS("get", get), \
-	DS("push", push), \
-    DS("clone_callable", clone_callable), \
-	DS("store_param", store_param), \
-	DS("pass_body", pass_body), \
-	DS("pass_param", pass_param), \
-	DS("call", call), \
-    DS("get_return_value", get_return_value), \
-	DS("%", mod), \
-	DS("*", mul), \
-	DS("/", divop), \
-	DS("+", add), \
-	DS("-", sub), \
-	DS("<<", shl), \
-	DS(">>", shr), \
-    DS("<", lop), \
-	DS("<=", leop), \
-	DS(">", gop), \
-	DS(">=", geop), \
-	DS("&", andop), \
-	DS("><", xorop), \
-	DS("|", orop) \
-
-#define __ADD_DEFAULT_STORE(fn, fn_name) { fn, fn_name }
-std::map<std::string, std::function<std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*>(Object*,std::optional<std::variant<Register, std::string, uint32_t>>,Interpreter&)>>
-default_stores_map ={
-		ENUMERATE_DEFAULT_STORES(__ADD_DEFAULT_STORE)
-};
-#undef __ADD_DEFAULT_STORE
\ No newline at end of file
+	DS(clone, clone_object) \
+	DS(equals, object_equals) \
+	DS(nequals, object_nequals) \
+	DS(store_value, store_value) \
+	DS(get, get) \
+	DS(push, push) \
+	DS(clone_callable, clone_callable) \
+	DS(store_param, store_param) \
+	DS(pass_body, pass_body) \
+	DS(mod, mod) \
+	DS(mul, mul) \
+	DS(div, divop) \
+	DS(add, add) \
+	DS(sub, sub) \
+	DS(shl, shl) \
+	DS(shr, shr) \
+	DS(lt, lop) \
+	DS(le, leop) \
+	DS(gt, gop) \
+	DS(ge, geop) \
+	DS(and_, andop) \
+	DS(xor_, xorop) \
+	DS(or_, orop)
+
+// indexed by the id of the default store's symbol
+std::vector<std::function<Value(Object*,std::optional<std::variant<Register, Symbol, uint32_t>>,Interpreter&)>>
+default_stores_map = [] {
+	std::vector<std::function<Value(Object*,std::optional<std::variant<Register, Symbol, uint32_t>>,Interpreter&)>> map(static_cast<uint32_t>(WellKnownSymbol::Count));
+#define __ADD_DEFAULT_STORE(symbol, fn) \
+	map[Symbols::symbol.get_id()] = fn;
+	ENUMERATE_DEFAULT_STORES(__ADD_DEFAULT_STORE)
+#undef __ADD_DEFAULT_STORE
+	return map;
+}();
@@ -24,15 +24,25 @@ t,
 #undef __ERROR_TYPES
 };
 
-inline void terminating_error(StampError error, std::string message) {
-#define __PRINT_ERROR(t, s) \
-	case StampError::t: std::cerr << s; break;
+inline char const *error_name(StampError error) {
+#define __ERROR_NAMES(t, s) \
+	case StampError::t: return s;
 
 	switch (error) {
-		ENUMERATE_ERROR_TYPES(__PRINT_ERROR)
+		ENUMERATE_ERROR_TYPES(__ERROR_NAMES)
 	}
+	return "";
+#undef __ERROR_NAMES
+}
 
-	std::cerr << ": " << message << "\n";
-	exit(1);
-#undef __PRINT_ERROR
-}
\ No newline at end of file
+// Error that stopped the code being compiled or run. The stamp executable prints it and exits, a VM returns it.
+struct StampException {
+	StampError error;
+	std::string message;
+
+	std::string to_string() const { return std::string(error_name(error)) + ": " + message; }
+};
+
+[[noreturn]] inline void terminating_error(StampError error, std::string message) {
+	throw StampException { error, std::move(message) };
+}
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algorithm>
 #include <iostream>
 #include <stdio.h>
 
@@ -12,31 +13,126 @@
 #include "Error.h"
 #include "AST.h"
 #include "Parser.h"
+#include "HeapImage.h"
+#include "ModuleCompiler.h"
 
 Register Generator::next_register() {
 	return Register(register_number++);
 }
 
+void Generator::rollback(Checkpoint const &checkpoint) {
+	// the arena keeps what was dropped until the generator is destroyed
+	basic_blocks.resize(checkpoint.num_basic_blocks);
+	num_basic_blocks = checkpoint.num_basic_blocks;
+	scopes.resize(checkpoint.num_scopes);
+	num_scopes = checkpoint.num_scopes;
+	register_number = checkpoint.register_number;
+	open_scopes.clear();
+	for (auto module = linked_modules.begin(); module != linked_modules.end();) {
+		if (module->second >= checkpoint.num_basic_blocks)
+			module = linked_modules.erase(module);
+		else
+			module++;
+	}
+	release_ast();
+}
+
 BasicBlock *Generator::add_basic_block() {
-	basic_blocks.push_back(new BasicBlock(num_basic_blocks));
+	basic_blocks.push_back(bytecode_arena.make<BasicBlock>(num_basic_blocks));
 	return basic_blocks[num_basic_blocks++];
 }
 
 LexicalScope *Generator::add_scope_beginning(uint32_t flags, bool can_be_global) {
-	if (can_be_global && (scopes.empty() || scopes[num_scopes - 1]->is_global))
-		scopes.push_back(new LexicalScope(add_basic_block()->get_index(), flags, can_be_global));
-	else
-		scopes.push_back(new LexicalScope(add_basic_block()->get_index(), flags, false));
-	return scopes[num_scopes++];
+	can_be_global = can_be_global && (open_scopes.empty() || open_scopes.back()->is_global);
+	scopes.push_back(bytecode_arena.make<LexicalScope>(add_basic_block()->get_index(), flags, can_be_global));
+	return open_scope();
 }
 
 LexicalScope *Generator::add_scope_beginning_current_bb(uint32_t flags, bool can_be_global) {
-	scopes.push_back(new LexicalScope(basic_blocks[num_basic_blocks - 1]->get_index(), flags, can_be_global));
-	return scopes[num_scopes++];
+	can_be_global = can_be_global && (open_scopes.empty() || open_scopes.back()->is_global);
+	scopes.push_back(bytecode_arena.make<LexicalScope>(basic_blocks[num_basic_blocks - 1]->get_index(), flags, can_be_global));
+	return open_scope();
+}
+
+LexicalScope *Generator::open_scope() {
+	auto scope = scopes[num_scopes];
+	scope->index = num_scopes++;
+	basic_blocks[scope->get_beginning()]->add_entered_scope(scope->index);
+	if (scope->can_return) {
+		scope->first_register = register_number;
+		for (auto enclosing = open_scopes.rbegin(); enclosing != open_scopes.rend(); enclosing++) {
+			if ((*enclosing)->can_return) {
+				scope->enclosing_function = (*enclosing)->get_beginning();
+				break;
+			}
+		}
+	}
+	open_scopes.push_back(scope);
+	return scope;
 }
 
 void Generator::end_scope(LexicalScope *scope) {
 	scope->end_scope(basic_blocks[num_basic_blocks - 1]->get_index());
+	if (scope->can_return)
+		scope->num_registers = register_number - scope->first_register;
+	if (!open_scopes.empty() && open_scopes.back() == scope)
+		open_scopes.pop_back();
+}
+
+uint32_t Generator::first_scope_from(uint32_t first_block) const {
+	auto first = std::partition_point(scopes.begin(), scopes.begin() + num_scopes,
+			[first_block](LexicalScope *scope) { return scope->get_beginning() < (int32_t)first_block; });
+	return first - scopes.begin();
+}
+
+LexicalScope *Generator::find_open_scope(bool LexicalScope::*flag) {
+	for (auto scope = open_scopes.rbegin(); scope != open_scopes.rend(); scope++) {
+		if ((*scope)->*flag)
+			return *scope;
+	}
+	return nullptr;
+}
+
+Variable Generator::declare(Symbol name) {
+	if (open_scopes.empty())
+		terminating_error(StampError::BytecodeGenerationError, "Variable " + name.str() + " declared outside of any scope.");
+
+	auto scope = open_scopes.back();
+	auto declared = scope->variables.find(name);
+	if (declared != scope->variables.end())
+		return declared->second;
+
+	LexicalScope *function = nullptr;
+	for (auto enclosing = open_scopes.rbegin(); enclosing != open_scopes.rend(); enclosing++) {
+		if ((*enclosing)->can_return) {
+			function = *enclosing;
+			break;
+		}
+	}
+
+	Variable variable(name);
+	if (function)
+		variable = Variable(name, 0, function->num_slots++);
+	else if (!scope->is_global)
+		variable = Variable(Symbol::intern("::" + name.str() + "." + std::to_string(scope->index)));
+	scope->variables.emplace(name, variable);
+	return variable;
+}
+
+Variable Generator::resolve(Symbol name) {
+	uint32_t depth = 0;
+	for (auto scope = open_scopes.rbegin(); scope != open_scopes.rend(); scope++) {
+		auto declared = (*scope)->variables.find(name);
+		if (declared != (*scope)->variables.end()) {
+			auto variable = declared->second;
+			if (variable.is_local)
+				variable.depth = depth;
+			return variable;
+		}
+		if ((*scope)->can_return)
+			depth++;
+	}
+	return Variable(name);
 }
 
 void Generator::dump() {
@@ -55,80 +151,278 @@ void Generator::dump_scopes() {
 		std::cout << scope->to_string() << "\n";
 }
 
-void Generator::write_to_file(std::string &filename) {
-	std::ofstream outfile(filename, std::ios::binary);
+void Generator::dump_constants() {
+	std::cout << "Constants:\n";
+	for (uint32_t i = 0; i < constants.size(); i++)
+		std::cout << "#" << i << " " << constants[i].to_string() << "\n";
+}
 
-	for (auto bb : basic_blocks) {
-		uint8_t bbyte = 0xbb;
-		outfile.write(reinterpret_cast<char*>(&bbyte), sizeof(uint8_t));
-		for (auto instr : bb->get_instructions()) {
-			instr->to_file(outfile);
+uint32_t Generator::add_constant(Symbol type, Symbol text) {
+	auto key = std::make_pair(type.get_id(), text.get_id());
+	auto it = constant_indices.find(key);
+	if (it != constant_indices.end())
+		return it->second;
+
+	Constant constant { type, text };
+	if (type == Symbols::Int) {
+		try {
+			constant.integer = std::stoi(text.str());
+		} catch (std::exception const &) {
+			terminating_error(StampError::BytecodeGenerationError, "Invalid Int literal: " + text.str() + ".");
 		}
 	}
+	constants.push_back(constant);
+	constant_indices.emplace(key, constants.size() - 1);
+	return constants.size() - 1;
+}
 
-	for (auto ls : scopes) {
-		ls->to_file(outfile);
+void Generator::write_to_file(std::string &filename, Interpreter *image_of) {
+	ObjectFileWriter file;
+
+	for (auto const &constant : constants)
+		constant.to_file(file);
+
+	for (auto bb : basic_blocks) {
+		file.begin_block(bb->get_entered_scopes());
+		for (auto instr : bb->get_instructions())
+			instr->to_file(file);
+		file.end_block();
 	}
 
-	outfile.close();
+	for (auto ls : scopes)
+		ls->to_file(file);
+
+	for (auto const &[name, block] : module_uses)
+		file.add_use(name, block);
+	if (module_source)
+		file.set_source(module_source->path, module_source->checksum, module_source->size, module_source->mtime);
+
+	if (image_of)
+		HeapImage::write(*image_of, file);
+
+	file.write(filename);
 }
 
 void Generator::read_from_file(std::string &filename) {
-	std::ifstream infile(filename, std::ios::binary);
-
-	BasicBlock *bb;
-	while (!infile.eof()) {
-		uint8_t first_byte = 0x00;
-		infile.read(reinterpret_cast<char*>(&first_byte), sizeof(uint8_t));
-		if (first_byte == 0xbb)
-			bb = add_basic_block();
-		else if (first_byte == 0xaa) {
-			scopes.push_back(LexicalScope::from_file(infile));
-			num_scopes++;
-		} else if (first_byte == 0x00)
+	auto file = std::make_unique<ObjectFileReader>(filename);
+	if (!file->is_open())
+		return;
+
+	auto first_new_block = num_basic_blocks;
+	auto file_constants = link(*file);
+
+	// an image is only valid for the blocks it was made with
+	if (file->has_image() && first_new_block == 0 && file->get_num_uses() == 0) {
+		image_file = std::move(file);
+		image_constants = std::move(file_constants);
+	}
+}
+
+std::vector<uint32_t> Generator::link(ObjectFileReader &file) {
+	// pool index of each constant of the file, which already may be in the pool
+	std::vector<uint32_t> file_constants;
+	for (uint32_t i = 0; i < file.get_num_constants(); i++) {
+		auto const &constant = file.constant(i);
+		file_constants.push_back(add_constant(file.symbol(constant.type), file.symbol(constant.text)));
+	}
+
+	// the instructions are read before the modules the file uses are linked, so that their registers come after
+	// the file's
+	auto first_register = register_number;
+	std::vector<std::vector<Instruction*>> code(file.get_num_blocks());
+	for (uint32_t i = 0; i < file.get_num_blocks(); i++) {
+		file.begin_block(file.block(i));
+		while (!file.at_block_end()) {
+			auto instruction = Instruction::from_file(file, bytecode_arena);
+			if (instruction->biggest_reg >= ObjectFile::MAX_REGISTERS - first_register)
+				file.fail("it uses register " + std::to_string(instruction->biggest_reg) + ", more than there can be");
+			if (first_register + instruction->biggest_reg >= register_number)
+				register_number = first_register + instruction->biggest_reg + 1;
+			if (first_register) {
+				for (auto reg : instruction->used_registers())
+					*reg = Register(reg->get_index() + first_register);
+				if (auto dst = instruction->destination())
+					*dst = Register(dst->get_index() + first_register);
+			}
+			if (instruction->get_type() == Instruction::Type::LoadConst) {
+				auto load = static_cast<LoadConst*>(instruction);
+				if (load->get_index() >= file_constants.size())
+					file.fail("it loads nonexistent constant " + std::to_string(load->get_index()));
+				load->set_index(file_constants[load->get_index()]);
+			}
+			code[i].push_back(instruction);
+		}
+	}
+
+	// Modules are linked in front of the block they were used at. Scopes are kept in the order they begin, so
+	// the ones of the file are placed as their first block is, and made once all blocks have their place.
+	std::vector<uint32_t> blocks(file.get_num_blocks() + 1);
+	std::vector<uint32_t> file_scopes(file.get_num_scopes());
+	uint32_t next_use = 0, next_scope = 0;
+	for (uint32_t i = 0; i <= file.get_num_blocks(); i++) {
+		for (; next_use < file.get_num_uses() && file.use(next_use).block == i; next_use++)
+			link_module(file.symbol(file.use(next_use).name).str());
+		blocks[i] = num_basic_blocks;
+		if (i == file.get_num_blocks())
 			break;
-		else if (bb) {
-			auto instruction = Instruction::from_file(infile, first_byte);
+		auto bb = add_basic_block();
+		for (auto instruction : code[i])
 			bb->add_instruction(instruction);
-			auto biggest_reg = instruction->biggest_reg;
-			if (biggest_reg > register_number)
-				register_number = biggest_reg + 1;
-		} else {
-			terminating_error(StampError::FileParsingError, "Unexpected first byte of file: " + std::to_string(first_byte) + ". The file might not be an object-stamp file.");
+		for (; next_scope < file.get_num_scopes() && file.scope(next_scope).beginning == (int32_t)i; next_scope++) {
+			file_scopes[next_scope] = num_scopes++;
+			scopes.push_back(nullptr);
 		}
 	}
+	if (next_scope < file.get_num_scopes())
+		file.fail("scope " + std::to_string(next_scope) + " is out of order");
 
-	infile.close();
-}
+	auto block = [&file, &blocks](int64_t index) {
+		if (index < 0 || index >= (int64_t)blocks.size())
+			file.fail("it refers to nonexistent block " + std::to_string(index));
+		return blocks[index];
+	};
+	auto scope = [&file, &file_scopes](uint32_t index) {
+		if (index >= file_scopes.size())
+			file.fail("it refers to nonexistent scope " + std::to_string(index));
+		return file_scopes[index];
+	};
+	// globals declared in blocks are named after their scope
+	auto variable = [&scope](Variable const &variable) {
+		auto const &name = variable.name.str();
+		auto dot = name.rfind('.');
+		if (variable.is_local || name.compare(0, 2, "::") != 0 || dot == std::string::npos || dot + 1 == name.size()
+				|| name.find_first_not_of("0123456789", dot + 1) != std::string::npos)
+			return variable;
+		return Variable(Symbol::intern(name.substr(0, dot + 1) + std::to_string(scope(std::stoul(name.substr(dot + 1))))));
+	};
 
-ASTNode *Generator::include_from(std::string &filename) {
-	std::string resolved_filename;
-	if (filename.find(".stamp") != std::string::npos)
-		resolved_filename = filename;
-	else
-		resolved_filename = filename + ".stamp";
-	for (auto const &dir : dirs) {
-		// FIXME: only works on unix systems
-		auto temp = dir + "/" + resolved_filename;
-		std::ifstream test(temp);
-		if (test.good()) {
-			resolved_filename = temp;
-			break;
+	for (uint32_t i = 0; i < file.get_num_scopes(); i++) {
+		auto record = file.scope(i);
+		record.beginning = block(record.beginning);
+		record.end = block(record.end);
+		if (record.flags & SCOPE_CAN_CONTINUE)
+			record.continue_dest = block(record.continue_dest);
+		if (record.flags & SCOPE_CAN_BREAK)
+			record.break_dest = block(record.break_dest);
+		if (record.enclosing_function >= 0)
+			record.enclosing_function = block(record.enclosing_function);
+		if (record.flags & SCOPE_CAN_RETURN) {
+			if (record.first_register >= ObjectFile::MAX_REGISTERS - first_register
+					|| record.num_registers > ObjectFile::MAX_REGISTERS - first_register - record.first_register)
+				file.fail("scope " + std::to_string(i) + " uses more registers than there can be");
+			record.first_register += first_register;
+			if (record.first_register + record.num_registers > register_number)
+				register_number = record.first_register + record.num_registers;
+		}
+		scopes[file_scopes[i]] = LexicalScope::from_file(record, bytecode_arena);
+		scopes[file_scopes[i]]->index = file_scopes[i];
+	}
+
+	// the blocks and scopes of a file read first stay where they are, and so do the names of its globals, but the
+	// targets of its jumps are checked all the same
+	bool moved = blocks.back() != file.get_num_blocks();
+	for (uint32_t i = 0; i < file.get_num_blocks(); i++) {
+		auto const &record = file.block(i);
+		auto bb = basic_blocks[blocks[i]];
+		for (uint32_t j = 0; j < record.num_entered_scopes; j++)
+			bb->add_entered_scope(scope(file.entered_scope(record, j)));
+		for (auto instruction : code[i]) {
+			switch (instruction->get_type()) {
+				case Instruction::Type::Jump: {
+					auto jump = static_cast<Jump*>(instruction);
+					jump->set_jump(block(jump->get_jump()));
+					break;
+				}
+				case Instruction::Type::JumpTrue: {
+					auto jump = static_cast<JumpTrue*>(instruction);
+					jump->set_jump(block(jump->get_jump()));
+					break;
+				}
+				case Instruction::Type::JumpFalse: {
+					auto jump = static_cast<JumpFalse*>(instruction);
+					jump->set_jump(block(jump->get_jump()));
+					break;
+				}
+				case Instruction::Type::Send: {
+					auto send = static_cast<Send*>(instruction);
+					if (send->get_stamp() && std::holds_alternative<uint32_t>(*send->get_stamp()))
+						send->set_stamp_block(block(std::get<uint32_t>(*send->get_stamp())));
+					break;
+				}
+				case Instruction::Type::Load: {
+					if (!moved)
+						break;
+					auto load = static_cast<Load*>(instruction);
+					load->set_value(variable(load->get_value()));
+					break;
+				}
+				case Instruction::Type::Bind: {
+					if (!moved)
+						break;
+					auto bind = static_cast<Bind*>(instruction);
+					bind->set_variable(variable(bind->get_variable()));
+					break;
+				}
+				default:
+					break;
+			}
 		}
 	}
 
-	std::ifstream source_file(resolved_filename);
+	return file_constants;
+}
+
+ASTNode *Generator::include_from(std::string &filename) {
+	return parse(add_source(Source::from_file(filename, ModuleCompiler::find_source(dirs, filename))), this);
+}
 
-	if (!source_file.is_open()) {
-		std::cerr << "Cannot find file to use: " << filename << ".\n";
-		exit(1);
+void Generator::use_module(std::string const &name) {
+	if (!open_scopes.empty() && !open_scopes.back()->is_global) {
+		// code used in a function runs with every call
+		auto filename = name;
+		if (auto ast = include_from(filename))
+			ast->generate_bytecode(*this);
+		return;
 	}
+	if (module_source) {
+		module_uses.push_back({ Symbol::intern(name), add_basic_block()->get_index() });
+		return;
+	}
+	link_module(name);
+	// the code after the use continues after the module
+	add_basic_block();
+}
 
-	std::vector<std::string> program;
-	std::string line;
-	while (getline(source_file, line)) {
-		program.push_back(line);
+void Generator::compile_modules(std::vector<std::string> const &names) {
+	if (module_source || names.empty() || (!open_scopes.empty() && !open_scopes.back()->is_global))
+		return;
+	for (auto &[path, module] : ModuleCompiler(dirs).compile(names)) {
+		if (!linked_modules.count(path))
+			compiled_modules[path] = std::move(module);
 	}
+}
+
+void Generator::link_module(std::string const &name) {
+	auto path = ModuleCompiler::real_path(dirs, name);
+	if (linked_modules.count(path))
+		return;
 
-	return parse(filename, program, this);
-}
\ No newline at end of file
+	// uses in blocks are not found ahead of the code, they are compiled as they are reached
+	if (!compiled_modules.count(path))
+		compile_modules({ path });
+	std::unique_ptr<ObjectFileReader> module;
+	auto compiled = compiled_modules.find(path);
+	if (compiled != compiled_modules.end()) {
+		module = std::move(compiled->second);
+		compiled_modules.erase(compiled);
+	}
+	// linked before the modules it uses, which may use it in turn
+	linked_modules.emplace(path, num_basic_blocks);
+	if (module) {
+		link(*module);
+		return;
+	}
+	// modules whose cache cannot be written, or that were not compiled, are generated in place
+	if (auto ast = include_from(path))
+		ast->generate_bytecode(*this);
+}
@@ -8,10 +8,16 @@
 
 #include <string>
 #include <vector>
-#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <optional>
 
 #include "Instruction.h"
 #include "BasicBlock.h"
+#include "Bytecode.h"
+#include "ObjectFile.h"
+#include "Source.h"
 
 #define SCOPE_CAN_CONTINUE  0b1
 #define SCOPE_CAN_BREAK     0b10
@@ -20,6 +26,7 @@
 class Instruction;
 class BasicBlock;
 class ASTNode;
+class Interpreter;
 
 class LexicalScope {
 public:
@@ -37,7 +44,8 @@ public:
 		if (can_break)
 			out += " (can break : " + std::to_string(break_dest) + ")";
 		if (can_return)
-			out += " (can return)";
+			out += " (can return : " + std::to_string(num_params) + " params, " + std::to_string(num_slots) + " slots, "
+					+ std::to_string(num_registers) + " registers from r" + std::to_string(first_register) + ")";
 		return out;
 	}
 
@@ -52,58 +60,36 @@ public:
 		scope_end = end;
 	}
 
+	int32_t get_beginning() const { return scope_beginning; }
+	int32_t get_end() const { return scope_end; }
 	bool starts_at(uint32_t index) { return scope_beginning == (int32_t)index; }
 	bool contains(uint32_t index) { return scope_beginning >= (int32_t)index && (int32_t)index <= scope_end; }
 	bool ends_at(uint32_t index) { return scope_end == (int32_t)index; }
 
 	void add_pending_break(Jump *pb) { pending_breaks.push_back(pb); }
 
-	void to_file(std::ofstream &outfile) {
-		uint8_t indicator = 0xaa;
+	void to_file(ObjectFileWriter &file) const {
 		uint8_t flags = 0;
 		if (can_continue)
-			flags = flags | 0b1;
+			flags = flags | SCOPE_CAN_CONTINUE;
 		if (can_break)
-			flags = flags | 0b10;
+			flags = flags | SCOPE_CAN_BREAK;
 		if (can_return)
-			flags = flags | 0b100;
-		uint8_t is_glbl = is_global ? 1 : 0;
-		outfile.write(reinterpret_cast<char*>(&indicator), sizeof(uint8_t));
-		outfile.write(reinterpret_cast<char*>(&is_glbl), sizeof(uint8_t));
-		outfile.write(reinterpret_cast<char*>(&scope_beginning), sizeof(int32_t));
-		outfile.write(reinterpret_cast<char*>(&flags), sizeof(uint8_t));
-		if (can_continue)
-			outfile.write(reinterpret_cast<char*>(&continue_dest), sizeof(uint32_t));
-		if (can_break)
-			outfile.write(reinterpret_cast<char*>(&break_dest), sizeof(uint32_t));
-		outfile.write(reinterpret_cast<char*>(&scope_end), sizeof(int32_t));
+			flags = flags | SCOPE_CAN_RETURN;
+		file.add_scope({ scope_beginning, scope_end, flags, is_global, continue_dest, break_dest, num_params, num_slots,
+				enclosing_function, first_register, num_registers });
 	}
 
-	static LexicalScope *from_file(std::ifstream &infile) {
-		uint8_t is_global;
-		infile.read(reinterpret_cast<char*>(&is_global), sizeof(uint8_t));
-		int32_t scope_beginning;
-		infile.read(reinterpret_cast<char*>(&scope_beginning), sizeof(int32_t));
-		uint8_t flags;
-		infile.read(reinterpret_cast<char*>(&flags), sizeof(uint8_t));
-
-		auto ls = new LexicalScope(scope_beginning, flags, is_global);
-
-		if (ls->can_continue) {
-			uint32_t dest;
-			infile.read(reinterpret_cast<char*>(&dest), sizeof(uint32_t));
-			ls->set_continue_dest(dest);
-		}
-		if (ls->can_break) {
-			uint32_t dest;
-			infile.read(reinterpret_cast<char*>(&dest), sizeof(uint32_t));
-			ls->set_break_dest(dest);
-		}
-
-		int32_t end;
-		infile.read(reinterpret_cast<char*>(&end), sizeof(int32_t));
-		ls->end_scope(end);
-
+	static LexicalScope *from_file(ObjectFile::ScopeRecord const &record, Arena &arena) {
+		auto ls = arena.make<LexicalScope>(record.beginning, record.flags, record.is_global);
+		ls->set_continue_dest(record.continue_dest);
+		ls->set_break_dest(record.break_dest);
+		ls->num_params = record.num_params;
+		ls->num_slots = record.num_slots;
+		ls->enclosing_function = record.enclosing_function;
+		ls->first_register = record.first_register;
+		ls->num_registers = record.num_registers;
+		ls->end_scope(record.end);
 		return ls;
 	}
 
@@ -112,6 +98,19 @@ public:
 	bool can_return = { false };
 
 	bool is_global = { false };
+
+	// functions have a frame: parameters take its first slots, followed by the variables of the function's scopes
+	uint32_t num_params = { 0 };
+	uint32_t num_slots = { 0 };
+	// beginning of the enclosing function, whose frame is the parent of this one
+	int32_t enclosing_function = { -1 };
+	// registers handed out while generating the function, they follow the slots in its frame
+	uint32_t first_register = { 0 };
+	uint32_t num_registers = { 0 };
+
+	// position in the generator's scopes and variables declared in the scope, only needed while generating
+	uint32_t index = { 0 };
+	std::unordered_map<Symbol, Variable> variables;
 private:
 	int32_t scope_beginning, scope_end;
 	uint32_t continue_dest = { 0 };
@@ -120,12 +119,36 @@ private:
 	std::vector<Jump*> pending_breaks;
 };
 
+// An Int, Char or String literal of the constant pool. Int literals are parsed once when they are added, the others
+// are made into objects by the interpreter the first time they are loaded.
+struct Constant {
+	Symbol type;
+	Symbol text;
+	int32_t integer = { 0 };
+
+	std::string to_string() const { return type.str() + " " + text.str(); }
+
+	void to_file(ObjectFileWriter &file) const { file.add_constant(type, text); }
+};
+
 class Generator {
 public:
-	Generator(std::vector<std::string> &dirs) : dirs(dirs) {}
+	Generator(std::vector<std::string> const &dirs) : dirs(dirs) {}
 	~Generator() = default;
 
 	Register next_register();
+	uint32_t get_num_registers() const { return register_number; }
+	// registers from first_unused on are not used by any code, e.g. after the register allocator renumbered them
+	void release_registers(uint32_t first_unused) { register_number = first_unused; }
+
+	// where to return to when code fails to compile, the blocks and scopes generated after it are dropped
+	struct Checkpoint {
+		uint32_t num_basic_blocks;
+		uint32_t num_scopes;
+		uint32_t register_number;
+	};
+	Checkpoint checkpoint() const { return { num_basic_blocks, num_scopes, register_number }; }
+	void rollback(Checkpoint const &checkpoint);
 
 	BasicBlock *add_basic_block();
 
@@ -138,28 +161,121 @@ public:
 	void dump();
 	void dump_basic_blocks();
 	void dump_scopes();
+	void dump_constants();
+
+	// index of a literal in the constant pool, equal literals share one constant
+	uint32_t add_constant(Symbol type, Symbol text);
+	Constant const &get_constant(uint32_t index) const { return constants[index]; }
+	uint32_t get_num_constants() const { return constants.size(); }
 
-	LexicalScope *get_scope(uint32_t index) { return scopes[index]; }
+	LexicalScope *get_scope(uint32_t index) { return index < scopes.size() ? scopes[index] : nullptr; }
 	uint32_t get_num_scopes() const { return num_scopes; }
+	// scopes are numbered in the order they begin, so the scopes beginning from first_block on are the last ones
+	uint32_t first_scope_from(uint32_t first_block) const;
+	// innermost scope that was begun but not ended yet with the flag set, e.g. &LexicalScope::can_break
+	LexicalScope *find_open_scope(bool LexicalScope::*flag);
+
+	// Declares a variable in the innermost open scope. Variables of functions get a slot in the function's frame,
+	// variables outside of functions are globals. Globals declared in blocks get an internal name unique to the
+	// block so that they are not visible outside of it.
+	Variable declare(Symbol name);
+	// finds the variable a name refers to from the innermost open scope, names that were not declared are globals
+	Variable resolve(Symbol name);
+
+	// instructions that optimization passes place in the blocks themselves
+	template<class T, typename... Args>
+	T *make_instruction(Args&&... args) {
+		return bytecode_arena.make<T>(std::forward<Args>(args)...);
+	}
 
 	template<class T, typename... Args>
 	T *append(Args&&... args) {
-		auto inst = new T(std::forward<Args>(args)...);
+		auto inst = make_instruction<T>(std::forward<Args>(args)...);
 		basic_blocks[basic_blocks.size() - 1]->add_instruction(static_cast<Instruction*>(inst));
 		return inst;
 	}
 
-	void write_to_file(std::string &filename);
+	Instruction *last_instruction() { return basic_blocks.back()->get_instructions().back(); }
+
+	// flat bytecode of all basic blocks, blocks added since the last call are assembled after the others
+	Bytecode &assemble() {
+		if (!bytecode.is_assembled_from(*this))
+			bytecode.assemble(*this);
+		return bytecode;
+	}
+
+	// also holds the slots of globals before anything was assembled
+	Bytecode &get_bytecode() { return bytecode; }
+
+	// with an interpreter that ran all blocks, an image of its heap is written with them
+	void write_to_file(std::string &filename, Interpreter *image_of = nullptr);
 	void read_from_file(std::string &filename);
 
+	// Heap image of the first file read, which the interpreter adopts instead of running the blocks of the file, and
+	// the pool indices of the file's constants. The file stays mapped until the image was adopted.
+	ObjectFileReader *get_image_file() { return image_file.get(); }
+	std::vector<uint32_t> const &get_image_constants() const { return image_constants; }
+	void release_image_file() { image_file.reset(); }
+
 	ASTNode *include_from(std::string &filename);
+	// Generates a use of a module. Outside of functions, the module's compiled code is linked in where it is used,
+	// once per generator. It is compiled into .stamp-cache next to the source if that cache is missing or out of date.
+	// Uses inside functions generate the module's code in place.
+	void use_module(std::string const &name);
+	// compiles the modules and the ones they use at once, ahead of their uses
+	void compile_modules(std::vector<std::string> const &names);
+
+	// AST nodes, and the sources their tokens refer to, live until the bytecode for them has been generated
+	Arena &get_ast_arena() { return ast_arena; }
+	Source const &add_source(std::unique_ptr<Source> source) { return *sources.emplace_back(std::move(source)); }
+	void release_ast() {
+		ast_arena.clear();
+		sources.clear();
+	}
 private:
+	LexicalScope *open_scope();
+
+	// Appends the blocks and scopes of a file after the ones generated so far, moving its block, scope, register and
+	// constant indices along. Returns the pool indices of the file's constants.
+	std::vector<uint32_t> link(ObjectFileReader &file);
+	// links a module unless it was linked before
+	void link_module(std::string const &name);
+
+	// the source of the module being compiled for its cache, whose uses are linked when the module is
+	struct ModuleSource {
+		Symbol path;
+		uint32_t checksum;
+		uint64_t size;
+		int64_t mtime;
+	};
+	std::optional<ModuleSource> module_source;
+	std::vector<std::pair<Symbol, uint32_t>> module_uses;
+	// real paths of the modules linked so far and the blocks they were linked at
+	std::unordered_map<std::string, uint32_t> linked_modules;
+	// caches of modules compiled ahead of their uses
+	std::unordered_map<std::string, std::unique_ptr<ObjectFileReader>> compiled_modules;
+
+	friend class ModuleCompiler;
+
 	uint32_t register_number = { 0 };
 	uint32_t num_basic_blocks = { 0 };
 	uint32_t num_scopes = { 0 };
 
 	std::vector<BasicBlock*> basic_blocks;
 	std::vector<LexicalScope*> scopes;
+	std::vector<Constant> constants;
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> constant_indices;
+	// scopes that were begun but not yet ended, innermost last
+	std::vector<LexicalScope*> open_scopes;
 
 	std::vector<std::string> dirs;
+
+	std::unique_ptr<ObjectFileReader> image_file;
+	std::vector<uint32_t> image_constants;
+
+	// owns instructions, basic blocks and scopes
+	Arena bytecode_arena;
+	Arena ast_arena;
+	std::vector<std::unique_ptr<Source>> sources;
+	Bytecode bytecode;
 };
\ No newline at end of file
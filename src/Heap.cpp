@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "Heap.h"
+#include "Interpreter.h"
+#include "InlineCache.h"
+
+void Heap::remove_roots(Interpreter *interpreter) {
+	interpreters.erase(std::remove(interpreters.begin(), interpreters.end(), interpreter), interpreters.end());
+}
+
+void Heap::collect() {
+	auto start = std::chrono::steady_clock::now();
+
+	for (auto interpreter : interpreters)
+		interpreter->visit_roots(*this);
+	while (!gray_cells.empty()) {
+		auto cell = gray_cells.back();
+		gray_cells.pop_back();
+		cell->visit_edges(*this);
+	}
+
+	for (auto link = &first_cell; *link;) {
+		auto cell = *link;
+		if (cell->is_marked) {
+			cell->is_marked = false;
+			link = &cell->next_cell;
+			continue;
+		}
+		*link = cell->next_cell;
+		statistics.live_cells--;
+		statistics.live_bytes -= cell->cell_size;
+		statistics.freed_bytes += cell->cell_size;
+		delete cell;
+	}
+
+	// inline caches may point at freed objects, stores and shapes
+	InlineCache::invalidate_all();
+
+	bytes_since_collection = 0;
+	collection_threshold = std::max(MIN_COLLECTION_THRESHOLD, statistics.live_bytes);
+
+	std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+	statistics.collections++;
+	statistics.total_pause_ms += pause.count();
+	statistics.max_pause_ms = std::max(statistics.max_pause_ms, pause.count());
+}
+
+void Heap::dump_statistics() const {
+	std::cout << "Heap live cells: " << statistics.live_cells << "\n";
+	std::cout << "Heap live bytes: " << statistics.live_bytes << "\n";
+	std::cout << "Heap allocated bytes: " << statistics.allocated_bytes << "\n";
+	std::cout << "Heap freed bytes: " << statistics.freed_bytes << "\n";
+	std::cout << "Collections: " << statistics.collections << "\n";
+	std::cout << "Total collection pause: " << statistics.total_pause_ms << " ms\n";
+	std::cout << "Max collection pause: " << statistics.max_pause_ms << " ms\n";
+}
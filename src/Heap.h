@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class Heap;
+class Interpreter;
+
+// Base of everything allocated on the garbage collected heap.
+class Cell {
+public:
+	Cell() {}
+	Cell(Cell const &) = delete;
+	Cell &operator=(Cell const &) = delete;
+	virtual ~Cell() = default;
+
+	// marks every cell this one references
+	virtual void visit_edges(Heap &) {}
+private:
+	friend class Heap;
+
+	Cell *next_cell = { nullptr };
+	uint32_t cell_size = { 0 };
+	bool is_marked = { false };
+};
+
+// Mark-and-sweep heap. Collections only happen at safe points chosen by the interpreter, when every live value is
+// reachable from its roots (registers, the call stack and the global frame). All interpreters of a process share the
+// heap, so a collection marks the roots of every interpreter that is alive.
+class Heap {
+public:
+	struct Statistics {
+		size_t live_cells = { 0 };
+		size_t live_bytes = { 0 };
+		size_t allocated_bytes = { 0 };
+		size_t freed_bytes = { 0 };
+		uint32_t collections = { 0 };
+		double total_pause_ms = { 0 };
+		double max_pause_ms = { 0 };
+	};
+
+	template<class T, typename... Args>
+	T *allocate(Args&&... args) {
+		auto cell = new T(std::forward<Args>(args)...);
+		cell->cell_size = sizeof(T);
+		cell->next_cell = first_cell;
+		first_cell = cell;
+		statistics.live_cells++;
+		statistics.live_bytes += sizeof(T);
+		statistics.allocated_bytes += sizeof(T);
+		bytes_since_collection += sizeof(T);
+		return cell;
+	}
+
+	void mark(Cell *cell) {
+		if (cell && !cell->is_marked) {
+			cell->is_marked = true;
+			gray_cells.push_back(cell);
+		}
+	}
+
+	// interpreters add their roots when they are made and remove them when they are destroyed, the cells only they
+	// reached are freed by the next collection
+	void add_roots(Interpreter *interpreter) { interpreters.push_back(interpreter); }
+	void remove_roots(Interpreter *interpreter);
+
+	bool should_collect() const { return bytes_since_collection >= collection_threshold; }
+	void collect();
+
+	Statistics const &get_statistics() const { return statistics; }
+	void dump_statistics() const;
+
+	static Heap &the() {
+		static Heap heap;
+		return heap;
+	}
+private:
+	// collect after this many bytes were allocated, or after as many bytes as survived the last collection
+	static constexpr size_t MIN_COLLECTION_THRESHOLD = 1 << 20;
+
+	Cell *first_cell = { nullptr };
+	std::vector<Cell*> gray_cells;
+	std::vector<Interpreter*> interpreters;
+	size_t bytes_since_collection = { 0 };
+	size_t collection_threshold = { MIN_COLLECTION_THRESHOLD };
+	Statistics statistics;
+};
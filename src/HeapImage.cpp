@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <functional>
+#include <unordered_map>
+
+#include "HeapImage.h"
+#include "Interpreter.h"
+
+using namespace ObjectFile;
+
+void HeapImage::write(Interpreter &interpreter, ObjectFileWriter &file) {
+	auto &image = file.get_image();
+
+	std::vector<Object*> objects;
+	std::vector<InternalStore*> stores;
+	std::vector<VecStorage*> vecs;
+	std::unordered_map<Object*, uint32_t> object_indices;
+	std::unordered_map<InternalStore*, uint32_t> store_indices;
+	std::unordered_map<VecStorage*, uint32_t> vec_indices;
+
+	std::function<uint32_t(Object*)> index_object = [&](Object *object) {
+		auto index = object_indices.find(object);
+		if (index != object_indices.end())
+			return index->second;
+		// prototypes are made first when the image is adopted
+		if (object->get_prototype())
+			index_object(object->get_prototype());
+		objects.push_back(object);
+		object_indices.emplace(object, objects.size() - 1);
+		return static_cast<uint32_t>(objects.size() - 1);
+	};
+	auto index_store = [&](InternalStore *store) {
+		auto index = store_indices.find(store);
+		if (index != store_indices.end())
+			return index->second;
+		stores.push_back(store);
+		store_indices.emplace(store, stores.size() - 1);
+		return static_cast<uint32_t>(stores.size() - 1);
+	};
+	auto index_vec = [&](std::vector<InternalStore*> *vec) {
+		auto storage = VecStorage::from(vec);
+		auto index = vec_indices.find(storage);
+		if (index != vec_indices.end())
+			return index->second;
+		vecs.push_back(storage);
+		vec_indices.emplace(storage, vecs.size() - 1);
+		return static_cast<uint32_t>(vecs.size() - 1);
+	};
+	auto value_record = [&](std::optional<Value> const &value) -> ValueRecord {
+		if (!value)
+			return { static_cast<uint32_t>(ValueKind::Empty), 0 };
+		if (auto object = std::get_if<Object*>(&*value))
+			return { static_cast<uint32_t>(ValueKind::Object), index_object(*object) };
+		if (auto string = std::get_if<std::string>(&*value))
+			return { static_cast<uint32_t>(ValueKind::String), file.symbol(Symbol::intern(*string)) };
+		if (auto integer = std::get_if<int32_t>(&*value))
+			return { static_cast<uint32_t>(ValueKind::Int), static_cast<uint32_t>(*integer) };
+		return { static_cast<uint32_t>(ValueKind::Vec), index_vec(std::get<std::vector<InternalStore*>*>(*value)) };
+	};
+
+	auto &bytecode = interpreter.generator.get_bytecode();
+	for (uint32_t slot = 0; slot < interpreter.global_frame->size(); slot++) {
+		if (auto object = interpreter.global_frame->get(slot))
+			image.globals.push_back({ file.symbol(bytecode.global_name(slot)), index_object(object) });
+	}
+	// the last register is the scratch register
+	for (uint32_t i = 0; i + 1 < interpreter.global_registers.size(); i++)
+		image.registers.push_back(value_record(interpreter.global_registers[i]));
+	for (uint32_t i = 0; i < interpreter.constants.size(); i++) {
+		if (interpreter.constants[i])
+			image.constants.push_back({ i, value_record(interpreter.constants[i]) });
+	}
+
+	// indexing an object, store or Vec can find more of them
+	for (size_t o = 0, s = 0, v = 0; o < objects.size() || s < stores.size() || v < vecs.size();) {
+		for (; o < objects.size(); o++) {
+			for (uint32_t i = 0; i < objects[o]->get_shape()->get_num_slots(); i++)
+				index_store(objects[o]->slot(i));
+		}
+		for (; s < stores.size(); s++) {
+			if (stores[s]->get_type() == InternalStore::Type::StoreObject)
+				index_object(static_cast<StoreObject*>(stores[s])->unwrap());
+			else if (stores[s]->get_type() == InternalStore::Type::StoreVec)
+				index_vec(static_cast<StoreVec*>(stores[s])->unwrap());
+		}
+		for (; v < vecs.size(); v++) {
+			for (auto element : *vecs[v])
+				index_store(element);
+		}
+	}
+
+	for (auto object : objects) {
+		auto shape = object->get_shape();
+		auto prototype = object->get_prototype() ? object_indices[object->get_prototype()] + 1 : 0;
+		image.objects.push_back({ file.symbol(object->get_type()), object->get_hash(), prototype,
+				static_cast<uint32_t>(image.slots.size()), shape->get_num_slots(),
+				static_cast<uint32_t>(shape->get_default_stores()), static_cast<uint32_t>(shape->get_default_stores() >> 32) });
+		for (uint32_t i = 0; i < shape->get_num_slots(); i++)
+			image.slots.push_back({ file.symbol(shape->get_slot_name(i)), store_indices[object->slot(i)] });
+	}
+	for (auto store : stores) {
+		uint32_t value = 0;
+		switch (store->get_type()) {
+			case InternalStore::Type::StoreObject:
+				value = object_indices[static_cast<StoreObject*>(store)->unwrap()];
+				break;
+			case InternalStore::Type::StoreLiteral:
+				value = file.symbol(Symbol::intern(static_cast<StoreLiteral*>(store)->unwrap()));
+				break;
+			case InternalStore::Type::StoreInt:
+				value = static_cast<uint32_t>(static_cast<StoreInt*>(store)->unwrap());
+				break;
+			case InternalStore::Type::StoreChar:
+				value = static_cast<uint8_t>(static_cast<StoreChar*>(store)->unwrap());
+				break;
+			case InternalStore::Type::StoreVec:
+				value = vec_indices[VecStorage::from(static_cast<StoreVec*>(store)->unwrap())];
+				break;
+			case InternalStore::Type::StoreRegister:
+				value = static_cast<StoreRegister*>(store)->unwrap();
+				break;
+		}
+		image.stores.push_back({ static_cast<uint32_t>(store->get_type()), store->is_mutable(), value });
+	}
+	for (auto vec : vecs) {
+		image.vecs.push_back({ static_cast<uint32_t>(image.elements.size()), static_cast<uint32_t>(vec->size()) });
+		for (auto element : *vec)
+			image.elements.push_back(store_indices[element]);
+	}
+}
+
+void HeapImage::adopt(Interpreter &interpreter, ObjectFileReader &file, std::vector<uint32_t> const &file_constants) {
+	auto check = [&file](bool condition, std::string const &problem) {
+		if (!condition)
+			file.fail("its heap image " + problem);
+	};
+	auto object_records = file.records<ObjectRecord>(Section::Objects);
+	auto slot_records = file.records<SlotRecord>(Section::Slots);
+	auto store_records = file.records<StoreRecord>(Section::Stores);
+	auto vec_records = file.records<VecRecord>(Section::Vecs);
+	auto elements = file.records<uint32_t>(Section::Elements);
+	auto &heap = Heap::the();
+
+	std::vector<Object*> objects(file.count(Section::Objects));
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		auto const &record = object_records[i];
+		check(record.prototype <= i, "has an object before its prototype");
+		objects[i] = heap.allocate<Object>(record.prototype ? objects[record.prototype - 1] : nullptr, file.symbol(record.type));
+		objects[i]->hash = record.hash;
+	}
+	std::vector<VecStorage*> vecs(file.count(Section::Vecs));
+	for (auto &vec : vecs)
+		vec = heap.allocate<VecStorage>();
+
+	std::vector<InternalStore*> stores(file.count(Section::Stores));
+	for (uint32_t i = 0; i < stores.size(); i++) {
+		auto const &record = store_records[i];
+		bool is_mutable = record.is_mutable;
+		switch (static_cast<InternalStore::Type>(record.type)) {
+			case InternalStore::Type::StoreObject:
+				check(record.value < objects.size(), "has a store of a nonexistent object");
+				stores[i] = heap.allocate<StoreObject>(objects[record.value], is_mutable);
+				break;
+			case InternalStore::Type::StoreLiteral:
+				stores[i] = heap.allocate<StoreLiteral>(file.symbol(record.value).str(), is_mutable);
+				break;
+			case InternalStore::Type::StoreInt:
+				stores[i] = heap.allocate<StoreInt>(static_cast<int32_t>(record.value), is_mutable);
+				break;
+			case InternalStore::Type::StoreChar:
+				stores[i] = heap.allocate<StoreChar>(static_cast<char>(record.value), is_mutable);
+				break;
+			case InternalStore::Type::StoreVec:
+				check(record.value < vecs.size(), "has a store of a nonexistent Vec");
+				stores[i] = heap.allocate<StoreVec>(vecs[record.value], is_mutable);
+				break;
+			case InternalStore::Type::StoreRegister:
+				stores[i] = heap.allocate<StoreRegister>(record.value, is_mutable);
+				break;
+			default:
+				check(false, "has a store of unknown type " + std::to_string(record.type));
+		}
+	}
+	auto store = [&](uint32_t index) {
+		check(index < stores.size(), "refers to a nonexistent store");
+		return stores[index];
+	};
+
+	for (uint32_t i = 0; i < vecs.size(); i++) {
+		auto const &record = vec_records[i];
+		check(record.first_element <= file.count(Section::Elements)
+				&& record.num_elements <= file.count(Section::Elements) - record.first_element, "has a Vec out of bounds");
+		for (uint32_t j = 0; j < record.num_elements; j++)
+			vecs[i]->push_back(store(elements[record.first_element + j]));
+	}
+
+	// the shape is rebuilt along the transitions objects made while the code ran, so that it is shared again
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		auto const &record = object_records[i];
+		check(record.first_slot <= file.count(Section::Slots) && record.num_slots <= file.count(Section::Slots) - record.first_slot,
+				"has an object with slots out of bounds");
+		auto object = objects[i];
+		auto shape = object->shape;
+		for (uint32_t j = 0; j < record.num_slots; j++) {
+			auto const &slot = slot_records[record.first_slot + j];
+			shape = shape->with_store(file.symbol(slot.name));
+			if (j < Object::INLINE_SLOTS)
+				object->inline_slots[j] = store(slot.store);
+			else
+				object->overflow_slots.push_back(store(slot.store));
+		}
+		auto default_stores = static_cast<uint64_t>(record.default_stores_high) << 32 | record.default_stores_low;
+		for (uint32_t id = 0; id < 64; id++) {
+			if (default_stores & (1ull << id))
+				shape = shape->with_default_store(Symbol(id));
+		}
+		object->shape = shape;
+	}
+
+	auto value = [&](ValueRecord const &record) -> std::optional<Value> {
+		switch (static_cast<ValueKind>(record.kind)) {
+			case ValueKind::Empty:
+				return std::nullopt;
+			case ValueKind::Object:
+				check(record.value < objects.size(), "has a value of a nonexistent object");
+				return objects[record.value];
+			case ValueKind::String:
+				return file.symbol(record.value).str();
+			case ValueKind::Int:
+				return static_cast<int32_t>(record.value);
+			case ValueKind::Vec:
+				check(record.value < vecs.size(), "has a value of a nonexistent Vec");
+				return static_cast<std::vector<InternalStore*>*>(vecs[record.value]);
+		}
+		check(false, "has a value of unknown kind " + std::to_string(record.kind));
+		return std::nullopt;
+	};
+
+	auto &bytecode = interpreter.generator.get_bytecode();
+	auto globals = file.records<GlobalRecord>(Section::Globals);
+	for (uint32_t i = 0; i < file.count(Section::Globals); i++) {
+		check(globals[i].object < objects.size(), "has a global of a nonexistent object");
+		auto slot = bytecode.add_global(file.symbol(globals[i].name));
+		interpreter.global_frame->resize(bytecode.get_num_globals());
+		interpreter.global_frame->set(slot, objects[globals[i].object]);
+	}
+
+	// registers no instruction of the file uses are left out
+	auto registers = file.records<ValueRecord>(Section::Registers);
+	for (uint32_t i = 0; i < file.count(Section::Registers) && i + 1 < interpreter.global_registers.size(); i++)
+		interpreter.global_registers[i] = value(registers[i]);
+
+	auto constants = file.records<ConstantValueRecord>(Section::ConstantValues);
+	interpreter.constants.resize(interpreter.generator.get_num_constants());
+	for (uint32_t i = 0; i < file.count(Section::ConstantValues); i++) {
+		check(constants[i].constant < file_constants.size(), "has a value of a nonexistent constant");
+		auto &constant = interpreter.constants[file_constants[constants[i].constant]];
+		constant = value(constants[i].value);
+		if (auto object = constant ? std::get_if<Object*>(&*constant) : nullptr; object && *object)
+			(*object)->make_literal();
+	}
+
+	interpreter.current_bb = file.get_num_blocks();
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ObjectFile.h"
+
+class Interpreter;
+
+// Image of the heap after the code of an object-stamp file was run. Written with the file, it lets later runs make
+// the objects the code made instead of running the code again, which is what every run does with the prelude.
+class HeapImage {
+public:
+	// records everything reachable from the globals, the registers outside of functions and the constants
+	static void write(Interpreter &interpreter, ObjectFileWriter &file);
+	// Makes the objects of the image of the first file read and points the globals, registers and constants at them.
+	// Execution continues after the blocks of the file. file_constants are the pool indices of the file's constants.
+	static void adopt(Interpreter &interpreter, ObjectFileReader &file, std::vector<uint32_t> const &file_constants);
+};
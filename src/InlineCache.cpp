@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "InlineCache.h"
+#include "Error.h"
+
+uint32_t InlineCache::epoch = 0;
+
+Value
+        InlineCache::send(Object *receiver, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> &stamp, Interpreter &interpreter) {
+	auto shape = receiver->get_shape();
+
+	if (cached_epoch != epoch) {
+		cached_epoch = epoch;
+		num_entries = 0;
+		is_megamorphic = false;
+	}
+
+	for (uint8_t i = 0; i < num_entries; i++) {
+		auto &entry = entries[i];
+		if (entry.shape != shape)
+			continue;
+		if (entry.own_slot >= 0)
+			return receiver->apply(Lookup { receiver, receiver->slot(entry.own_slot), false }, message, stamp, interpreter);
+		return receiver->apply(entry.lookup, message, stamp, interpreter);
+	}
+
+	auto lookup = receiver->lookup(message);
+	if (!lookup)
+		return receiver->send(message, stamp, nullptr, interpreter);
+
+	if (num_entries == INLINE_CACHE_ENTRIES) {
+		is_megamorphic = true;
+	} else if (!is_megamorphic) {
+		if (lookup.holder == receiver)
+			entries[num_entries++] = Entry { shape, lookup.is_default ? -1 : shape->slot_of(message), Lookup { nullptr, nullptr, lookup.is_default } };
+		else
+			entries[num_entries++] = Entry { shape, -1, lookup };
+	}
+
+	return receiver->apply(lookup, message, stamp, interpreter);
+}
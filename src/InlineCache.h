@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "Object.h"
+#include "Register.h"
+#include "Symbol.h"
+
+class Interpreter;
+
+#define INLINE_CACHE_ENTRIES 4
+
+// Per-Send cache of message lookups keyed by the receiver's shape. A hit either names the receiver's own slot or the
+// store/default store found along the prototype chain. Up to INLINE_CACHE_ENTRIES shapes are remembered before the
+// send site is treated as megamorphic. Any mutation of an object that is a prototype bumps the global epoch, which
+// invalidates every cache.
+class InlineCache {
+public:
+	InlineCache() {}
+
+	Value
+	        send(Object *receiver, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> &stamp, Interpreter &interpreter);
+
+	static void invalidate_all() { epoch++; }
+private:
+	struct Entry {
+		Shape *shape;
+		// slot of the store if the receiver holds it itself, -1 otherwise
+		int32_t own_slot;
+		Lookup lookup;
+	};
+
+	static uint32_t epoch;
+
+	uint32_t cached_epoch = { 0 };
+	uint8_t num_entries = { 0 };
+	bool is_megamorphic = { false };
+	Entry entries[INLINE_CACHE_ENTRIES];
+};
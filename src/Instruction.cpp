@@ -10,92 +10,121 @@
 
 #include "Instruction.h"
 #include "Register.h"
-#include "Interpreter.h"
+#include "Bytecode.h"
 #include "Error.h"
+#include "ObjectFile.h"
 
-void Instruction::execute(Interpreter &interpreter) {
+void Instruction::assemble(Bytecode &bytecode) const {
 #define __INSTRUCTION_TYPES(t, b)                       \
 		case Instruction::Type::t:                      \
-			static_cast<t&>(*this).execute(interpreter);         \
+			static_cast<t const&>(*this).assemble(bytecode);  \
 			break;
 
 	switch(type) {
 		ENUMERATE_INSTRUCTION_TYPES(__INSTRUCTION_TYPES)
 		default:
-			terminating_error(StampError::ExecutionError, "No execution implementation for instruction.");
+			terminating_error(StampError::ExecutionError, "No assembly implemented for instruction.");
 	}
 
 #undef __INSTRUCTION_TYPES
 }
 
-void Load::execute(Interpreter &interpreter) {
-	if (value == "default")
-		interpreter.store_at(dst.get_index(), value);
+void Load::assemble(Bytecode &bytecode) const {
+	if (value.is_local)
+		bytecode.emit(Opcode::LoadLocal, { bytecode.reg(dst), value.depth, value.slot, bytecode.add_symbol(value.name) });
+	else if (value.name == Symbols::default_)
+		bytecode.emit(Opcode::LoadDefault, { bytecode.reg(dst) });
 	else
-		interpreter.store_at(dst.get_index(), interpreter.fetch_object(value));
-}
-
-void Store::execute(Interpreter &interpreter) {
-	auto object = std::get_if<Object*>(&interpreter.at(obj.get_index()));
-	if (object) {
-		auto st_register = interpreter.at(store.get_index());
-		auto st = std::get_if<Object*>(&st_register);
-		if (st)
-			(*object)->add_store<StoreObject>(store_name, *st, is_mutable);
-		else {
-			auto store = std::get<std::string>(st_register);
-			if (store == "default") {
-				std::set<std::string> dstores = {store_name};
-				(*object)->add_default_stores(dstores);
-			} else
-				(*object)->add_store<StoreLiteral>(store_name, store, is_mutable);
+		bytecode.emit(Opcode::LoadGlobal, { bytecode.reg(dst), bytecode.add_global(value.name) });
+}
+
+void Send::assemble(Bytecode &bytecode) const {
+	auto stamp_kind = StampKind::None;
+	uint32_t stamp_operand = 0;
+	if (stamp) {
+		if (auto reg = std::get_if<Register>(&*stamp)) {
+			stamp_kind = StampKind::Register;
+			stamp_operand = bytecode.reg(*reg);
+		} else if (auto name = std::get_if<Symbol>(&*stamp)) {
+			stamp_kind = StampKind::Symbol;
+			stamp_operand = bytecode.add_symbol(*name);
+		} else {
+			stamp_kind = StampKind::Block;
+			stamp_operand = std::get<uint32_t>(*stamp);
 		}
-	} else {
-		terminating_error(StampError::ExecutionError, "Attempted to store to not an object.");
 	}
+	bytecode.emit(Opcode::Send, { bytecode.reg(dst), bytecode.reg(obj), bytecode.add_symbol(msg), static_cast<uint32_t>(stamp_kind),
+			stamp_operand, bytecode.add_inline_cache() });
 }
 
-void Send::execute(Interpreter &interpreter) {
-	auto object = std::get_if<Object*>(&interpreter.at(obj.get_index()));
-	if (object) {
-		interpreter.store_at(dst.get_index(), (*object)->send(msg, stamp, nullptr, interpreter));
-	} else {
-		terminating_error(StampError::ExecutionError, "Attempted to send to not an object.");
-	}
+void Store::assemble(Bytecode &bytecode) const {
+	bytecode.emit(Opcode::Store, { bytecode.reg(obj), bytecode.add_symbol(store_name), bytecode.reg(store), is_mutable });
 }
 
-void Jump::execute(Interpreter &interpreter) {
-	interpreter.jump_bb(block_index);
+void Jump::assemble(Bytecode &bytecode) const {
+	bytecode.emit_jump(Opcode::Jump, block_index, {});
 }
 
-void JumpTrue::execute(Interpreter &interpreter) {
-	auto object = std::get_if<Object*>(&interpreter.at(condition.get_index()));
-	if (*object == interpreter.fetch_global_object("True"))
-		interpreter.jump_bb(block_index);
+void JumpTrue::assemble(Bytecode &bytecode) const {
+	bytecode.emit_jump(Opcode::JumpTrue, block_index, { bytecode.reg(condition) });
 }
 
-void JumpFalse::execute(Interpreter &interpreter) {
-	auto object = std::get_if<Object*>(&interpreter.at(condition.get_index()));
-	if (*object == interpreter.fetch_global_object("False"))
-		interpreter.jump_bb(block_index);
+void JumpFalse::assemble(Bytecode &bytecode) const {
+	bytecode.emit_jump(Opcode::JumpFalse, block_index, { bytecode.reg(condition) });
 }
 
-void JumpSaved::execute(Interpreter &interpreter) {
-	interpreter.push_retval(retval);
-	interpreter.jump_saved_bb();
+void Return::assemble(Bytecode &bytecode) const {
+	bytecode.emit(Opcode::Return, { retval.has_value(), retval ? bytecode.reg(*retval) : 0 });
 }
 
-void Instruction::dealloc() {
-#define __INSTRUCTION_TYPES(t, b)                          \
+void Bind::assemble(Bytecode &bytecode) const {
+	if (variable.is_local)
+		bytecode.emit(Opcode::BindLocal, { variable.depth, variable.slot, bytecode.reg(src) });
+	else
+		bytecode.emit(Opcode::BindGlobal, { bytecode.add_global(variable.name), bytecode.reg(src) });
+}
+
+void Call::assemble(Bytecode &bytecode) const {
+	// arguments are pushed onto the stack, where they become the first slots of the called function's frame
+	for (auto argument : arguments)
+		bytecode.emit(Opcode::Arg, { bytecode.reg(argument) });
+	bytecode.emit(is_tail_call ? Opcode::TailCall : Opcode::Call, { bytecode.reg(dst), bytecode.reg(callee), static_cast<uint32_t>(arguments.size()) });
+}
+
+void LoadConst::assemble(Bytecode &bytecode) const {
+	bytecode.emit(Opcode::LoadConst, { bytecode.reg(dst), index });
+}
+
+std::optional<Register> Instruction::defined_register() const {
+	auto dst = const_cast<Instruction*>(this)->destination();
+	if (dst)
+		return *dst;
+	return std::nullopt;
+}
+
+Register *Instruction::destination() {
+#define __INSTRUCTION_TYPES(t, b)                       \
 		case Instruction::Type::t:                      \
-			static_cast<t&>(*this).~t();                   \
-			return;
+			return static_cast<t&>(*this).destination();
 
 	switch(type) {
 		ENUMERATE_INSTRUCTION_TYPES(__INSTRUCTION_TYPES)
-		default: {
-			terminating_error(StampError::ExecutionError, "No deallocation implemented for instruction.");
-		}
+		default:
+			return nullptr;
+	}
+
+#undef __INSTRUCTION_TYPES
+}
+
+std::vector<Register*> Instruction::used_registers() {
+#define __INSTRUCTION_TYPES(t, b)                       \
+		case Instruction::Type::t:                      \
+			return static_cast<t&>(*this).used_registers();
+
+	switch(type) {
+		ENUMERATE_INSTRUCTION_TYPES(__INSTRUCTION_TYPES)
+		default:
+			return {};
 	}
 
 #undef __INSTRUCTION_TYPES
@@ -115,20 +144,26 @@ std::string Instruction::to_string() const {
 #undef __INSTRUCTION_TYPES
 }
 
+std::string Variable::to_string() const {
+	if (!is_local)
+		return name.str();
+	return name.str() + " [" + std::to_string(depth) + ":" + std::to_string(slot) + "]";
+}
+
 std::string Load::to_string() const {
 	std::stringstream s;
-	s << "Load r" << dst.get_index() << ", " << value;
+	s << "Load r" << dst.get_index() << ", " << value.to_string();
 	return s.str();
 }
 
 std::string Send::to_string() const {
 	std::stringstream s;
-	s << "Send r" << dst.get_index() << ", r" << obj.get_index() << ", " << msg;
+	s << "Send r" << dst.get_index() << ", r" << obj.get_index() << ", " << msg.str();
 	if (stamp.has_value()) {
 		s << ", ";
-		auto *str = std::get_if<std::string>(&*stamp);
-		if (str)
-			s << *str;
+		auto *name = std::get_if<Symbol>(&*stamp);
+		if (name)
+			s << name->str();
 		else {
 			auto *bb = std::get_if<uint32_t>(&*stamp);
 			if (bb)
@@ -142,7 +177,7 @@ std::string Send::to_string() const {
 
 std::string Store::to_string() const {
 	std::stringstream s;
-	s << "Store r" << obj.get_index() << ", " << store_name << ", r" << store.get_index();
+	s << "Store r" << obj.get_index() << ", " << store_name.str() << ", r" << store.get_index();
 	if (is_mutable)
 		s << ", mut";
 	return s.str();
@@ -166,19 +201,39 @@ std::string JumpFalse::to_string() const {
 	return s.str();
 }
 
-std::string JumpSaved::to_string() const {
+std::string Return::to_string() const {
 	std::stringstream s;
-	s << "JumpSaved";
-	if (retval) {
-		s << " " << std::to_string((*retval).get_index());
-	}
+	s << "Return";
+	if (retval)
+		s << " r" << (*retval).get_index();
+	return s.str();
+}
+
+std::string Bind::to_string() const {
+	std::stringstream s;
+	s << "Bind " << variable.to_string() << ", r" << src.get_index();
+	return s.str();
+}
+
+std::string Call::to_string() const {
+	std::stringstream s;
+	s << (is_tail_call ? "TailCall r" : "Call r") << dst.get_index() << ", r" << callee.get_index() << "(";
+	for (long unsigned int i = 0; i < arguments.size(); i++)
+		s << (i ? ", r" : "r") << arguments[i].get_index();
+	s << ")";
+	return s.str();
+}
+
+std::string LoadConst::to_string() const {
+	std::stringstream s;
+	s << "LoadConst r" << dst.get_index() << ", #" << index;
 	return s.str();
 }
 
-void Instruction::to_file(std::ofstream &outfile) const {
+void Instruction::to_file(ObjectFileWriter &file) const {
 #define __INSTRUCTION_TYPES(t, b)                          \
 		case Instruction::Type::t:                      \
-			static_cast<t const&>(*this).to_file(outfile, b); break;
+			static_cast<t const&>(*this).to_file(file, b); break;
 
 	switch(type) {
 		ENUMERATE_INSTRUCTION_TYPES(__INSTRUCTION_TYPES)
@@ -190,104 +245,103 @@ void Instruction::to_file(std::ofstream &outfile) const {
 #undef __INSTRUCTION_TYPES
 }
 
-void Load::to_file(std::ofstream &outfile, uint8_t code) const {
-	uint32_t dst_index = dst.get_index();
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	outfile.write(reinterpret_cast<char*>(&dst_index), sizeof(uint32_t));
-	uint32_t size = value.size();
-	const char *str = value.c_str();
-	outfile.write(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-	outfile.write(str, size);
-}
-
-void Send::to_file(std::ofstream &outfile, uint8_t code) const {
-	uint32_t dst_index = dst.get_index();
-	uint32_t obj_index = obj.get_index();
-	uint32_t msg_size = msg.size();
-	const char *msg_str = msg.c_str();
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	outfile.write(reinterpret_cast<char*>(&dst_index), sizeof(uint32_t));
-	outfile.write(reinterpret_cast<char*>(&obj_index), sizeof(uint32_t));
-	outfile.write(reinterpret_cast<char*>(&msg_size), sizeof(uint32_t));
-	outfile.write(msg_str, msg_size);
-
-	uint8_t stamp_type = 0x00;
-	if (stamp.has_value()) {
-		stamp_type = std::holds_alternative<Register>(*stamp) ? 0x01 :
-				(std::holds_alternative<std::string>(*stamp) ? 0x02 : 0x03);
-	}
-	outfile.write(reinterpret_cast<char*>(&stamp_type), sizeof(uint8_t));
-	if (stamp_type == 0x01) {
-		uint32_t st = std::get<Register>(*stamp).get_index();
-		outfile.write(reinterpret_cast<char*>(&st), sizeof(uint32_t));
-	} else if (stamp_type == 0x02) {
-		std::string st = std::get<std::string>(*stamp);
-		uint32_t size = st.size();
-		const char *st_str = st.c_str();
-		outfile.write(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		outfile.write(st_str, size);
-	} else if (stamp_type == 0x03) {
-		uint32_t st = std::get<uint32_t>(*stamp);
-		outfile.write(reinterpret_cast<char*>(&st), sizeof(uint32_t));
+void Variable::to_file(ObjectFileWriter &file) const {
+	file.word(file.symbol(name));
+	file.word(is_local);
+	file.word(depth);
+	file.word(slot);
+}
+
+void Load::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(dst.get_index());
+	value.to_file(file);
+}
+
+void Send::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(dst.get_index());
+	file.word(obj.get_index());
+	file.word(file.symbol(msg));
+
+	if (!stamp.has_value()) {
+		file.word(static_cast<uint32_t>(StampKind::None));
+		file.word(0);
+	} else if (auto reg = std::get_if<Register>(&*stamp)) {
+		file.word(static_cast<uint32_t>(StampKind::Register));
+		file.word(reg->get_index());
+	} else if (auto symbol = std::get_if<Symbol>(&*stamp)) {
+		file.word(static_cast<uint32_t>(StampKind::Symbol));
+		file.word(file.symbol(*symbol));
+	} else {
+		file.word(static_cast<uint32_t>(StampKind::Block));
+		file.word(std::get<uint32_t>(*stamp));
 	}
 }
 
-void Store::to_file(std::ofstream &outfile, uint8_t code) const {
-	uint32_t obj_index = obj.get_index();
-	uint32_t store_size = store_name.size();
-	const char *store_str = store_name.c_str();
-	uint32_t store_index = store.get_index();
-	uint8_t is_mut = is_mutable;
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	outfile.write(reinterpret_cast<char*>(&obj_index), sizeof(uint32_t));
-	outfile.write(reinterpret_cast<char*>(&store_size), sizeof(uint32_t));
-	outfile.write(store_str, store_size);
-	outfile.write(reinterpret_cast<char*>(&store_index), sizeof(uint32_t));
-	outfile.write(reinterpret_cast<char*>(&is_mut), sizeof(uint8_t));
+void Store::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(obj.get_index());
+	file.word(file.symbol(store_name));
+	file.word(store.get_index());
+	file.word(is_mutable);
 }
 
-void Jump::to_file(std::ofstream &outfile, uint8_t code) const {
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	// have to do this because otherwise reinterpret_cast does not like it
-	uint32_t b_index = block_index;
-	outfile.write(reinterpret_cast<char*>(&b_index), sizeof(uint32_t));
+void Jump::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(block_index);
 }
 
-void JumpTrue::to_file(std::ofstream &outfile, uint8_t code) const {
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	// have to do this because otherwise reinterpret_cast does not like it
-	uint32_t b_index = block_index;
-	outfile.write(reinterpret_cast<char*>(&b_index), sizeof(uint32_t));
-	uint32_t condition_index = condition.get_index();
-	outfile.write(reinterpret_cast<char*>(&condition_index), sizeof(uint32_t));
+void JumpTrue::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(block_index);
+	file.word(condition.get_index());
 }
 
-void JumpFalse::to_file(std::ofstream &outfile, uint8_t code) const {
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	// have to do this because otherwise reinterpret_cast does not like it
-	uint32_t b_index = block_index;
-	outfile.write(reinterpret_cast<char*>(&b_index), sizeof(uint32_t));
-	uint32_t condition_index = condition.get_index();
-	outfile.write(reinterpret_cast<char*>(&condition_index), sizeof(uint32_t));
+void JumpFalse::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(block_index);
+	file.word(condition.get_index());
 }
 
-void JumpSaved::to_file(std::ofstream &outfile, uint8_t code) const {
-	outfile.write(reinterpret_cast<char*>(&code), sizeof(uint8_t));
-	// FIXME: this assumes that 0 is never the return register
-	// FIXME: which is always true in the current implementation but might not be in the future
-	auto ret = retval ? (*retval).get_index() : 0;
-	outfile.write(reinterpret_cast<char*>(&ret), sizeof(uint8_t));
+void Return::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(retval.has_value());
+	file.word(retval ? retval->get_index() : 0);
 }
 
-Instruction* Instruction::from_file(std::ifstream &infile, uint8_t code) {
+void Bind::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(src.get_index());
+	variable.to_file(file);
+}
+
+void Call::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(dst.get_index());
+	file.word(callee.get_index());
+	file.word(is_tail_call);
+	file.word(arguments.size());
+	for (auto argument : arguments)
+		file.word(argument.get_index());
+}
+
+void LoadConst::to_file(ObjectFileWriter &file, uint8_t code) const {
+	file.word(code);
+	file.word(dst.get_index());
+	file.word(index);
+}
+
+Instruction* Instruction::from_file(ObjectFileReader &file, Arena &arena) {
 #define __INSTRUCTION_TYPES(t, b) \
     case b: \
-	return static_cast<Instruction *>(t::from_file(infile));
+	return static_cast<Instruction *>(t::from_file(file, arena));
 
+	auto code = file.word();
 	switch (code) {
 		ENUMERATE_INSTRUCTION_TYPES(__INSTRUCTION_TYPES)
 		default: {
-			terminating_error(StampError::ExecutionError, "Unrecognized instruction code: " + std::to_string(code) + ".");
+			terminating_error(StampError::FileParsingError, "Unrecognized instruction code: " + std::to_string(code) + ".");
 			return nullptr;
 		}
 	}
@@ -295,122 +349,134 @@ Instruction* Instruction::from_file(std::ifstream &infile, uint8_t code) {
 #undef __INSTRUCTION_TYPES
 }
 
-Load *Load::from_file(std::ifstream &infile) {
-	uint32_t index;
-	infile.read(reinterpret_cast<char*>(&index), sizeof(uint32_t));
-	uint32_t size;
-	infile.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-	char value[size+1];
-	infile.read(reinterpret_cast<char*>(&value), size);
-	value[size] = '\0';
+Variable Variable::from_file(ObjectFileReader &file) {
+	auto name = file.symbol(file.word());
+	auto is_local = file.word();
+	auto depth = file.word();
+	auto slot = file.word();
+	if (!is_local)
+		return Variable(name);
+	return Variable(name, depth, slot);
+}
+
+Load *Load::from_file(ObjectFileReader &file, Arena &arena) {
+	auto dst = file.word();
 
-	auto load = new Load(Register(index), value);
-	load->biggest_reg = index;
+	auto load = arena.make<Load>(Register(dst), Variable::from_file(file));
+	load->biggest_reg = dst;
 	return load;
 }
 
-Send *Send::from_file(std::ifstream &infile) {
-	uint32_t dst;
-	infile.read(reinterpret_cast<char*>(&dst), sizeof(uint32_t));
-	uint32_t obj;
-	infile.read(reinterpret_cast<char*>(&obj), sizeof(uint32_t));
-	uint32_t msg_size;
-	infile.read(reinterpret_cast<char*>(&msg_size), sizeof(uint32_t));
-	char msg[msg_size+1];
-	infile.read(reinterpret_cast<char*>(&msg), msg_size);
-	msg[msg_size] = '\0';
-
-	auto biggest_reg_so_far = dst > obj ? dst : obj;
+Send *Send::from_file(ObjectFileReader &file, Arena &arena) {
+	auto dst = file.word();
+	auto obj = file.word();
+	auto msg = file.symbol(file.word());
+	auto stamp_kind = static_cast<StampKind>(file.word());
+	auto stamp = file.word();
 
+	auto biggest_reg = dst > obj ? dst : obj;
 	Send *send;
-	uint8_t stamp_type;
-	infile.read(reinterpret_cast<char*>(&stamp_type), sizeof(uint8_t));
-	if (stamp_type == 0x00) {
-		std::optional<uint32_t> st = std::nullopt;
-		send = new Send(dst, obj, msg, st);
-		send->biggest_reg = biggest_reg_so_far;
-	} else if (stamp_type == 0x01) {
-		uint32_t r_index;
-		infile.read(reinterpret_cast<char*>(&r_index), sizeof(uint32_t));
-		std::optional<Register> st = Register(r_index);
-		send = new Send(dst, obj, msg, st);
-		send->biggest_reg = biggest_reg_so_far > r_index ? biggest_reg_so_far : r_index;
-	} else if (stamp_type == 0x02) {
-		uint32_t st_size;
-		infile.read(reinterpret_cast<char*>(&st_size), sizeof(uint32_t));
-		char stamp[st_size+1];
-		infile.read(reinterpret_cast<char*>(&stamp), st_size);
-		stamp[st_size] = '\0';
-		std::optional<std::string> st = std::string(stamp);
-		send = new Send(dst, obj, msg, st);
-		send->biggest_reg = biggest_reg_so_far;
-	} else if (stamp_type == 0x03) {
-		uint32_t bb_index;
-		infile.read(reinterpret_cast<char*>(&bb_index), sizeof(uint32_t));
-		std::optional<uint32_t> st = bb_index;
-		send = new Send(dst, obj, msg, st);
-		send->biggest_reg = biggest_reg_so_far;
-	} else {
-		terminating_error(StampError::FileParsingError, "Unrecognized stamp type: " + std::to_string(stamp_type) + ".");
-		return nullptr;
+	switch (stamp_kind) {
+		case StampKind::None:
+			send = arena.make<Send>(dst, obj, msg, std::optional<uint32_t>());
+			break;
+		case StampKind::Register:
+			send = arena.make<Send>(dst, obj, msg, std::optional<Register>(Register(stamp)));
+			biggest_reg = biggest_reg > stamp ? biggest_reg : stamp;
+			break;
+		case StampKind::Symbol:
+			send = arena.make<Send>(dst, obj, msg, std::optional<Symbol>(file.symbol(stamp)));
+			break;
+		case StampKind::Block:
+			send = arena.make<Send>(dst, obj, msg, std::optional<uint32_t>(stamp));
+			break;
+		default:
+			terminating_error(StampError::FileParsingError, "Unrecognized stamp type: " + std::to_string(static_cast<uint32_t>(stamp_kind)) + ".");
+			return nullptr;
 	}
+	send->biggest_reg = biggest_reg;
 	return send;
 }
 
-Store *Store::from_file(std::ifstream &infile) {
-	uint32_t dst;
-	infile.read(reinterpret_cast<char*>(&dst), sizeof(uint32_t));;
-	uint32_t store_size;
-	infile.read(reinterpret_cast<char*>(&store_size), sizeof(uint32_t));
-	char store_name[store_size+1];
-	infile.read(reinterpret_cast<char*>(&store_name), store_size);
-	store_name[store_size] = '\0';
-	uint32_t store;
-	infile.read(reinterpret_cast<char*>(&store), sizeof(uint32_t));
-	uint8_t is_mutable;
-	infile.read(reinterpret_cast<char*>(&is_mutable), sizeof(uint8_t));
-
-	auto st = new Store(dst, store_name, store, is_mutable);
-	st->biggest_reg = dst > store ? dst : store;
+Store *Store::from_file(ObjectFileReader &file, Arena &arena) {
+	auto obj = file.word();
+	auto store_name = file.symbol(file.word());
+	auto store = file.word();
+	auto is_mutable = file.word();
+
+	auto st = arena.make<Store>(obj, store_name, store, is_mutable);
+	st->biggest_reg = obj > store ? obj : store;
 	return st;
 }
 
-Jump *Jump::from_file(std::ifstream &infile) {
-	uint32_t block_index;
-	infile.read(reinterpret_cast<char*>(&block_index), sizeof(uint32_t));
-
-	return new Jump(block_index);
+Jump *Jump::from_file(ObjectFileReader &file, Arena &arena) {
+	return arena.make<Jump>(file.word());
 }
 
-JumpTrue *JumpTrue::from_file(std::ifstream &infile) {
-	uint32_t block_index;
-	infile.read(reinterpret_cast<char*>(&block_index), sizeof(uint32_t));
-	uint32_t condition;
-	infile.read(reinterpret_cast<char*>(&condition), sizeof(uint32_t));
+JumpTrue *JumpTrue::from_file(ObjectFileReader &file, Arena &arena) {
+	auto block_index = file.word();
+	auto condition = file.word();
 
-	auto jump = new JumpTrue(block_index, Register(condition));
+	auto jump = arena.make<JumpTrue>(block_index, Register(condition));
 	jump->biggest_reg = condition;
 	return jump;
 }
 
-JumpFalse *JumpFalse::from_file(std::ifstream &infile) {
-	uint32_t block_index;
-	infile.read(reinterpret_cast<char*>(&block_index), sizeof(uint32_t));
-	uint32_t condition;
-	infile.read(reinterpret_cast<char*>(&condition), sizeof(uint32_t));
+JumpFalse *JumpFalse::from_file(ObjectFileReader &file, Arena &arena) {
+	auto block_index = file.word();
+	auto condition = file.word();
 
-	auto jump = new JumpFalse(block_index, Register(condition));
+	auto jump = arena.make<JumpFalse>(block_index, Register(condition));
 	jump->biggest_reg = condition;
 	return jump;
 }
 
-JumpSaved *JumpSaved::from_file(std::ifstream &infile) {
-	// FIXME: this assumes that 0 is never the return register
-	// FIXME: which is always true in the current implementation but might not be in the future
-	uint32_t ret;
-	infile.read(reinterpret_cast<char*>(&ret), sizeof(uint32_t));
-	if (ret == 0)
-		return new JumpSaved;
-	else
-		return new JumpSaved(Register(ret));
-}
\ No newline at end of file
+Return *Return::from_file(ObjectFileReader &file, Arena &arena) {
+	auto has_retval = file.word();
+	auto ret = file.word();
+	if (!has_retval)
+		return arena.make<Return>();
+
+	auto instruction = arena.make<Return>(Register(ret));
+	instruction->biggest_reg = ret;
+	return instruction;
+}
+
+Bind *Bind::from_file(ObjectFileReader &file, Arena &arena) {
+	auto src = file.word();
+
+	auto bind = arena.make<Bind>(Variable::from_file(file), Register(src));
+	bind->biggest_reg = src;
+	return bind;
+}
+
+Call *Call::from_file(ObjectFileReader &file, Arena &arena) {
+	auto dst = file.word();
+	auto callee = file.word();
+	auto is_tail_call = file.word();
+	auto num_arguments = file.word();
+
+	auto biggest_reg = dst > callee ? dst : callee;
+	std::vector<Register> arguments;
+	for (uint32_t i = 0; i < num_arguments; i++) {
+		auto argument = file.word();
+		arguments.push_back(Register(argument));
+		if (argument > biggest_reg)
+			biggest_reg = argument;
+	}
+
+	auto call = arena.make<Call>(Register(dst), Register(callee), std::move(arguments));
+	if (is_tail_call)
+		call->set_tail_call();
+	call->biggest_reg = biggest_reg;
+	return call;
+}
+
+LoadConst *LoadConst::from_file(ObjectFileReader &file, Arena &arena) {
+	auto dst = file.word();
+	auto index = file.word();
+
+	auto load = arena.make<LoadConst>(Register(dst), index);
+	load->biggest_reg = dst;
+	return load;
+}
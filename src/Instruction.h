@@ -10,11 +10,35 @@
 #include <variant>
 #include <optional>
 #include <cinttypes>
-#include <fstream>
+#include <vector>
 
+#include "Arena.h"
 #include "Register.h"
+#include "Symbol.h"
 
-class Interpreter;
+class Bytecode;
+class ObjectFileReader;
+class ObjectFileWriter;
+
+// A variable as resolved by the generator. Globals are kept by name and get their slot in the global frame when
+// assembled, locals live in the frame of the function `depth` functions out from the current one.
+struct Variable {
+	Variable(Symbol name) : name(name) {}
+	Variable(Symbol name, uint32_t depth, uint32_t slot) : name(name), is_local(true), depth(depth), slot(slot) {}
+
+	std::string to_string() const;
+	void to_file(ObjectFileWriter &file) const;
+	static Variable from_file(ObjectFileReader &file);
+
+	bool operator==(Variable const &other) const {
+		return name == other.name && is_local == other.is_local && depth == other.depth && slot == other.slot;
+	}
+
+	Symbol name;
+	bool is_local = { false };
+	uint32_t depth = { 0 };
+	uint32_t slot = { 0 };
+};
 
 #define ENUMERATE_INSTRUCTION_TYPES(T)       \
 	T(Send, 0x01)                            \
@@ -23,7 +47,10 @@ class Interpreter;
     T(Jump, 0x04)                            \
 	T(JumpTrue, 0x05)                        \
 	T(JumpFalse, 0x06)                       \
-	T(JumpSaved, 0x07)
+	T(Return, 0x07)                          \
+	T(Bind, 0x08)                            \
+	T(Call, 0x09)                            \
+	T(LoadConst, 0x0a)
 
 class Instruction {
 public:
@@ -35,16 +62,22 @@ public:
 	};
 
 	Instruction(Type type) : type(type) {}
-	static Instruction *from_file(std::ifstream &infile, uint8_t code);
-	void dealloc();
+	static Instruction *from_file(ObjectFileReader &file, Arena &arena);
 
 	Type get_type() const { return type; }
 
 	std::string to_string() const;
-	// FIXME: should be error or void
-	void execute(Interpreter &interpreter);
+	// appends the flat encoding of the instruction
+	void assemble(Bytecode &bytecode) const;
+
+	void to_file(ObjectFileWriter &file) const;
 
-	void to_file(std::ofstream &outfile) const;
+	// register the instruction writes, if any
+	std::optional<Register> defined_register() const;
+	// registers the instruction reads, which optimization passes and the register allocator may rewrite
+	std::vector<Register*> used_registers();
+	// register the instruction writes, which the register allocator may rewrite
+	Register *destination();
 
 	uint32_t biggest_reg = { 0 };
 private:
@@ -53,56 +86,79 @@ private:
 
 class Load final : public Instruction {
 public:
-	Load(Register dst, std::string value) : Instruction(Type::Load), dst(dst), value(value) {}
-	static Load *from_file(std::ifstream &infile);
+	Load(Register dst, Variable value) : Instruction(Type::Load), dst(dst), value(value) {}
+	static Load *from_file(ObjectFileReader &file, Arena &arena);
+
+	Register get_dst() const { return dst; }
+	Variable const &get_value() const { return value; }
+	void set_value(Variable variable) { value = variable; }
+	std::vector<Register*> used_registers() { return {}; }
+	Register *destination() { return &dst; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	Register dst;
-	std::string value;
+	Variable value;
 };
 
 class Send final : public Instruction {
 public:
-	Send(Register dst, Register obj, std::string msg, std::optional<Register> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
+	Send(Register dst, Register obj, Symbol msg, std::optional<Register> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
 		if (st)
 			stamp = *st;
 	}
-	Send(Register dst, Register obj, std::string msg, std::optional<std::string> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
+	Send(Register dst, Register obj, Symbol msg, std::optional<Symbol> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
 		if (st)
 			stamp = *st;
 	}
-	Send(Register dst, Register obj, std::string msg, std::optional<uint32_t> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
+	Send(Register dst, Register obj, Symbol msg, std::optional<uint32_t> st) : Instruction(Type::Send), dst(dst), obj(obj), msg(msg) {
 		if (st)
 			stamp = *st;
 	}
 	Send(const Send& other) : Instruction(Type::Send), dst(other.dst), obj(other.obj), msg(other.msg), stamp(other.stamp) {}
-	static Send *from_file(std::ifstream &infile);
+	static Send *from_file(ObjectFileReader &file, Arena &arena);
+
+	Register get_dst() const { return dst; }
+	Register get_obj() const { return obj; }
+	Symbol get_message() const { return msg; }
+	std::optional<std::variant<Register, Symbol, uint32_t>> const &get_stamp() const { return stamp; }
+	// moves the body of a function that is passed as the stamp
+	void set_stamp_block(uint32_t block) { stamp = block; }
+	std::vector<Register*> used_registers() {
+		if (stamp && std::holds_alternative<Register>(*stamp))
+			return { &obj, &std::get<Register>(*stamp) };
+		return { &obj };
+	}
+	Register *destination() { return &dst; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	Register dst;
 	Register obj;
-	std::string msg;
-	std::optional<std::variant<Register, std::string, uint32_t>> stamp;
+	Symbol msg;
+	std::optional<std::variant<Register, Symbol, uint32_t>> stamp;
 };
 
 class Store final : public Instruction {
 public:
-	Store(Register obj, std::string store_name, Register store, bool is_mutable) :
+	Store(Register obj, Symbol store_name, Register store, bool is_mutable) :
 			Instruction(Type::Store), obj(obj), store_name(store_name), store(store), is_mutable(is_mutable) {}
-	static Store *from_file(std::ifstream &infile);
+	static Store *from_file(ObjectFileReader &file, Arena &arena);
+
+	Register get_obj() const { return obj; }
+	std::vector<Register*> used_registers() { return { &obj, &store }; }
+	Register *destination() { return nullptr; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	Register obj;
-	std::string store_name;
+	Symbol store_name;
 	Register store;
 	bool is_mutable = { false };
 };
@@ -110,13 +166,16 @@ private:
 class Jump final : public Instruction {
 public:
 	Jump(uint32_t block_index) : Instruction(Type::Jump), block_index(block_index) {}
-	static Jump *from_file(std::ifstream &infile);
+	static Jump *from_file(ObjectFileReader &file, Arena &arena);
 
+	uint32_t get_jump() const { return block_index; }
 	void set_jump(uint32_t jump_location) { block_index = jump_location; }
+	std::vector<Register*> used_registers() { return {}; }
+	Register *destination() { return nullptr; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	uint32_t block_index;
 };
@@ -125,13 +184,17 @@ class JumpTrue final : public Instruction {
 public:
 	JumpTrue(uint32_t block_index, Register condition) : Instruction(Type::JumpTrue), block_index(block_index), condition(condition) {}
 	JumpTrue(Register condition) : Instruction(Type::JumpTrue), block_index(0), condition(condition) {}
-	static JumpTrue *from_file(std::ifstream &infile);
+	static JumpTrue *from_file(ObjectFileReader &file, Arena &arena);
 
+	uint32_t get_jump() const { return block_index; }
 	void set_jump(uint32_t jump_location) { block_index = jump_location; }
+	Register get_condition() const { return condition; }
+	std::vector<Register*> used_registers() { return { &condition }; }
+	Register *destination() { return nullptr; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	uint32_t block_index;
 	Register condition;
@@ -141,27 +204,109 @@ class JumpFalse final : public Instruction {
 public:
 	JumpFalse(uint32_t block_index, Register condition) : Instruction(Type::JumpFalse), block_index(block_index), condition(condition) {}
 	JumpFalse(Register condition) : Instruction(Type::JumpFalse), block_index(0), condition(condition) {}
-	static JumpFalse *from_file(std::ifstream &infile);
+	static JumpFalse *from_file(ObjectFileReader &file, Arena &arena);
 
+	uint32_t get_jump() const { return block_index; }
 	void set_jump(uint32_t jump_location) { block_index = jump_location; }
+	Register get_condition() const { return condition; }
+	std::vector<Register*> used_registers() { return { &condition }; }
+	Register *destination() { return nullptr; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	uint32_t block_index;
 	Register condition;
 };
 
-class JumpSaved final : public Instruction {
+// returns from the function being executed, optionally with a value for the register the call result goes to
+class Return final : public Instruction {
 public:
-	JumpSaved() : Instruction(Type::JumpSaved), retval({}) {}
-	JumpSaved(std::optional<Register> retval) : Instruction(Type::JumpSaved), retval(retval) {}
-	static JumpSaved *from_file(std::ifstream &infile);
+	Return() : Instruction(Type::Return), retval({}) {}
+	Return(std::optional<Register> retval) : Instruction(Type::Return), retval(retval) {}
+	static Return *from_file(ObjectFileReader &file, Arena &arena);
+
+	std::vector<Register*> used_registers() {
+		if (retval)
+			return { &*retval };
+		return {};
+	}
+	Register *destination() { return nullptr; }
 
 	std::string to_string() const;
-	void execute(Interpreter &interpreter);
-	void to_file(std::ofstream &outfile, uint8_t code) const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
 private:
 	std::optional<Register> retval;
-};
\ No newline at end of file
+};
+
+// binds the object in a register to a variable, emitted after the clone that declares it
+class Bind final : public Instruction {
+public:
+	Bind(Variable variable, Register src) : Instruction(Type::Bind), variable(variable), src(src) {}
+	static Bind *from_file(ObjectFileReader &file, Arena &arena);
+
+	Variable const &get_variable() const { return variable; }
+	void set_variable(Variable new_variable) { variable = new_variable; }
+	Register get_src() const { return src; }
+	std::vector<Register*> used_registers() { return { &src }; }
+	Register *destination() { return nullptr; }
+
+	std::string to_string() const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
+private:
+	Variable variable;
+	Register src;
+};
+
+// calls the function object in a register with the arguments in registers, the result is stored in dst once it returns
+class Call final : public Instruction {
+public:
+	Call(Register dst, Register callee, std::vector<Register> arguments) :
+			Instruction(Type::Call), dst(dst), callee(callee), arguments(std::move(arguments)) {}
+	static Call *from_file(ObjectFileReader &file, Arena &arena);
+
+	// the result is returned right away, so the call does not need a frame of its own
+	void set_tail_call() { is_tail_call = true; }
+
+	Register get_dst() const { return dst; }
+	std::vector<Register*> used_registers() {
+		std::vector<Register*> used = { &callee };
+		for (auto &argument : arguments)
+			used.push_back(&argument);
+		return used;
+	}
+	Register *destination() { return &dst; }
+
+	std::string to_string() const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
+private:
+	Register dst;
+	Register callee;
+	std::vector<Register> arguments;
+	bool is_tail_call = { false };
+};
+
+// loads a literal of the generator's constant pool
+class LoadConst final : public Instruction {
+public:
+	LoadConst(Register dst, uint32_t index) : Instruction(Type::LoadConst), dst(dst), index(index) {}
+	static LoadConst *from_file(ObjectFileReader &file, Arena &arena);
+
+	Register get_dst() const { return dst; }
+	uint32_t get_index() const { return index; }
+	// constants of a file are renumbered when they are added to the pool
+	void set_index(uint32_t constant) { index = constant; }
+	std::vector<Register*> used_registers() { return {}; }
+	Register *destination() { return &dst; }
+
+	std::string to_string() const;
+	void assemble(Bytecode &bytecode) const;
+	void to_file(ObjectFileWriter &file, uint8_t code) const;
+private:
+	Register dst;
+	uint32_t index;
+};
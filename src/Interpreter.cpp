@@ -8,89 +8,505 @@
 
 #include "Interpreter.h"
 #include "Error.h"
+#include "HeapImage.h"
 
 void Interpreter::run() {
-	uint32_t lexical_scope_index = 0;
-	while (current_bb < generator.get_num_bbs()) {
-		auto bb = generator.get_bbs()[current_bb];
-
-		// add all lexical scopes that start with the current basic block index to the context
-		LexicalScope *lscope = generator.get_scope(lexical_scope_index);
-		while (lscope && lscope->starts_at(current_bb)) {
-			if (current_bb == 0) {
-				global_scope.add_scope(lscope, Context::make_global_context());
-				in_global_scope = true;
-			} else if (lscope->is_global) {
-				global_scope.add_lscope(lscope);
-				in_global_scope = true;
-			}
-			else {
-				scopes.add_scope(lscope, new Context());
-				in_global_scope = false;
-			}
-			lscope = generator.get_scope(++lexical_scope_index);
-		}
+	reserve_registers();
+
+	bytecode = &generator.assemble();
+	global_frame->resize(bytecode->get_num_globals());
+	pc = bytecode->block_offset(current_bb);
+#ifdef STAMP_THREADED_DISPATCH
+	run_threaded();
+#else
+	run_switch();
+#endif
+}
+
+void Interpreter::abandon() {
+	calls.clear();
+	set_register_window();
+	current_bb = generator.get_num_bbs();
+}
+
+void Interpreter::run_switch() {
+	auto code = bytecode->get_code();
+	auto size = bytecode->get_size();
+
+	while (pc < size) {
+		auto opcode = static_cast<Opcode>(code[pc]);
+		auto operands = code + pc + 1;
+		// advance first so that jumps can overwrite pc
+		pc += Bytecode::num_operands(opcode) + 1;
 
-		// execute instruction within the current basic block
-		for (auto instruction : bb->get_instructions()) {
-			instruction->execute(*this);
-			if (should_terminate_bb)
+		switch (opcode) {
+			case Opcode::EnterBlock:
+				enter_block(operands[0]);
+				break;
+			case Opcode::ExitBlock:
+				exit_block(operands[0]);
+				break;
+			case Opcode::EnterFrame:
+				enter_frame(operands[0], operands[1]);
+				break;
+			case Opcode::LoadDefault:
+				store_at(operands[0], Symbols::default_.str());
+				break;
+			case Opcode::LoadConst:
+				execute_load_const(operands);
+				break;
+			case Opcode::LoadGlobal:
+				execute_load_global(operands);
+				break;
+			case Opcode::LoadLocal:
+				execute_load_local(operands);
+				break;
+			case Opcode::BindGlobal:
+				execute_bind_global(operands);
+				break;
+			case Opcode::BindLocal:
+				execute_bind_local(operands);
+				break;
+			case Opcode::Send:
+				execute_send(operands);
+				break;
+			case Opcode::Store:
+				execute_store(operands);
+				break;
+			case Opcode::Jump:
+				pc = operands[0];
+				break;
+			case Opcode::JumpTrue:
+				if (holds_global_object(operands[1], true_slot))
+					pc = operands[0];
+				break;
+			case Opcode::JumpFalse:
+				if (holds_global_object(operands[1], false_slot))
+					pc = operands[0];
+				break;
+			case Opcode::Arg:
+				calls.push_argument(at(operands[0]));
+				break;
+			case Opcode::Call:
+				execute_call(operands, false);
+				break;
+			case Opcode::TailCall:
+				execute_call(operands, true);
+				break;
+			case Opcode::Return:
+				execute_return(operands);
 				break;
 		}
+	}
+}
+
+#ifdef STAMP_THREADED_DISPATCH
+// Every handler jumps straight to the handler of the next instruction and jumps go to the address stored in the
+// threaded code. The ip is the only program counter while executing; pc is synced around instructions that may
+// jump through it (Call and Return).
+void Interpreter::run_threaded() {
+	static void const *const handlers[] = {
+#define __OPCODES(op, n) \
+		&&op_##op,
+		ENUMERATE_OPCODES(__OPCODES)
+#undef __OPCODES
+	};
+	if (!bytecode->is_threaded())
+		bytecode->thread(handlers, &&end);
+
+	// operands are read from the flat code, which has the same layout as the threaded code
+	auto code = bytecode->get_code();
+	auto threaded = bytecode->get_threaded_code();
+	auto ip = threaded + pc;
 
-		if (should_terminate_bb) {
-			should_terminate_bb = false;
-			continue;
+#define OPERANDS (code + (ip - threaded) + 1)
+#define DISPATCH() goto *const_cast<void*>(*ip)
+#define NEXT(op)                                     \
+	ip += Bytecode::num_operands(Opcode::op) + 1; \
+	DISPATCH()
+#define JUMP() \
+	ip = static_cast<void const *const *>(ip[1]); \
+	DISPATCH()
+
+	DISPATCH();
+op_EnterBlock:
+	enter_block(OPERANDS[0]);
+	NEXT(EnterBlock);
+op_ExitBlock:
+	exit_block(OPERANDS[0]);
+	NEXT(ExitBlock);
+op_EnterFrame:
+	enter_frame(OPERANDS[0], OPERANDS[1]);
+	NEXT(EnterFrame);
+op_LoadDefault:
+	store_at(OPERANDS[0], Symbols::default_.str());
+	NEXT(LoadDefault);
+op_LoadConst:
+	execute_load_const(OPERANDS);
+	NEXT(LoadConst);
+op_LoadGlobal:
+	execute_load_global(OPERANDS);
+	NEXT(LoadGlobal);
+op_LoadLocal:
+	execute_load_local(OPERANDS);
+	NEXT(LoadLocal);
+op_BindGlobal:
+	execute_bind_global(OPERANDS);
+	NEXT(BindGlobal);
+op_BindLocal:
+	execute_bind_local(OPERANDS);
+	NEXT(BindLocal);
+op_Send:
+	execute_send(OPERANDS);
+	NEXT(Send);
+op_Store:
+	execute_store(OPERANDS);
+	NEXT(Store);
+op_Jump:
+	JUMP();
+op_JumpTrue:
+	if (holds_global_object(OPERANDS[1], true_slot)) {
+		JUMP();
+	}
+	NEXT(JumpTrue);
+op_JumpFalse:
+	if (holds_global_object(OPERANDS[1], false_slot)) {
+		JUMP();
+	}
+	NEXT(JumpFalse);
+op_Arg:
+	calls.push_argument(at(OPERANDS[0]));
+	NEXT(Arg);
+op_Call:
+	pc = ip - threaded + Bytecode::num_operands(Opcode::Call) + 1;
+	execute_call(OPERANDS, false);
+	ip = threaded + pc;
+	DISPATCH();
+op_TailCall:
+	pc = ip - threaded + Bytecode::num_operands(Opcode::TailCall) + 1;
+	execute_call(OPERANDS, true);
+	ip = threaded + pc;
+	DISPATCH();
+op_Return:
+	execute_return(OPERANDS);
+	ip = threaded + pc;
+	DISPATCH();
+end:
+	pc = ip - threaded;
+
+#undef OPERANDS
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+}
+#endif
+
+void Interpreter::make_global_frame() {
+	auto &globals = generator.get_bytecode();
+	int_slot = globals.add_global(Symbols::Int);
+	true_slot = globals.add_global(Symbols::True);
+	false_slot = globals.add_global(Symbols::False);
+	auto object_slot = globals.add_global(Symbols::Object);
+
+	global_frame = Heap::the().allocate<Context>(globals.get_num_globals());
+	global_frame->set(object_slot, Context::make_object_prototype());
+
+	// the objects made by the code of the prelude, instead of running it
+	if (auto image = generator.get_image_file()) {
+		HeapImage::adopt(*this, *image, generator.get_image_constants());
+		generator.release_image_file();
+	}
+}
+
+void Interpreter::execute_call(uint32_t const *operands, bool is_tail_call) {
+	auto callee = std::get_if<Object*>(&at(operands[1]));
+	auto body = callee ? (*callee)->get_store(Symbols::body) : nullptr;
+	if (!body || body->get_type() != InternalStore::Type::StoreRegister) {
+		terminating_error(StampError::ExecutionError, "Attempted to call not a function.");
+		return;
+	}
+
+	// the arguments were pushed right before the call, the called function's EnterFrame completes the frame
+	calls.push_call(operands[2], pc, operands[0], is_tail_call);
+	jump_bb(static_cast<StoreRegister*>(body)->unwrap());
+}
+
+void Interpreter::enter_frame(uint32_t scope_index, uint32_t frame_size) {
+	auto function = generator.get_scope(scope_index);
+	if (calls.back().num_arguments != function->num_params) {
+		terminating_error(StampError::ExecutionError, "Function expects " + std::to_string(function->num_params) + " parameters, "
+				+ std::to_string(calls.back().num_arguments) + " were passed.");
+		return;
+	}
+
+	auto parent = enclosing_frame(function);
+	// a tail call replaces the frame of its caller, unless it is the frame the called function's variables refer to
+	if (calls.back().is_tail_call && calls.size() > 1 && parent != (int32_t)calls.size() - 2)
+		calls.replace_caller();
+
+	auto &call = calls.back();
+	call.function = function;
+	call.parent = parent;
+	calls.enter_frame(frame_size);
+	set_register_window();
+}
+
+void Interpreter::execute_return(uint32_t const *operands) {
+	if (calls.empty()) {
+		terminating_error(StampError::ExecutionError, "Attempted to return outside of a function.");
+		return;
+	}
+
+	Value value = operands[0] ? at(operands[1]) : Value(static_cast<Object*>(nullptr));
+	auto call = calls.pop_call();
+	set_register_window();
+	store_at(call.return_register, std::move(value));
+	pc = call.return_pc;
+}
+
+void Interpreter::set_register_window() {
+	if (calls.empty()) {
+		registers = global_registers.data();
+		num_registers = global_registers.size();
+		return;
+	}
+	auto &call = calls.back();
+	registers = calls.values(call) + call.function->num_slots;
+	num_registers = call.function->num_registers + 1;
+}
+
+int32_t Interpreter::enclosing_frame(LexicalScope *function) {
+	if (function->enclosing_function < 0)
+		return -1;
+	// the enclosing function is being executed if the called function could be reached from the caller
+	for (int32_t frame = calls.size() - 2; frame >= 0; frame = calls[frame].parent) {
+		if (calls[frame].function->starts_at(function->enclosing_function))
+			return frame;
+	}
+	terminating_error(StampError::ExecutionError, "Function called after the function enclosing it returned.");
+	return -1;
+}
+
+std::optional<Value> &Interpreter::local_slot(uint32_t depth, uint32_t slot) {
+	if (calls.empty())
+		terminating_error(StampError::ExecutionError, "Attempted to read a local variable outside of a function.");
+	int32_t frame = calls.size() - 1;
+	while (depth--)
+		frame = calls[frame].parent;
+	return calls.values(calls[frame])[slot];
+}
+
+void Interpreter::enter_block(uint32_t bb_index) {
+	// block boundaries are safe points: every live value is in a register or a frame
+	if (Heap::the().should_collect())
+		Heap::the().collect();
+
+	current_bb = bb_index;
+}
+
+void Interpreter::exit_block(uint32_t bb_index) {
+	current_bb = bb_index + 1;
+}
+
+void Interpreter::execute_load_const(uint32_t const *operands) {
+	if (operands[1] >= constants.size())
+		constants.resize(generator.get_num_constants());
+	auto &constant = constants[operands[1]];
+	if (!constant)
+		constant = make_constant(generator.get_constant(operands[1]));
+	store_at(operands[0], *constant);
+}
+
+// Ints are unboxed, Chars and Strings are made once, when their prototypes have been defined by the prelude. Every
+// load of the literal shares the object, so it is sealed: its value cannot be reassigned and no stores can be added
+Value Interpreter::make_constant(Constant const &constant) {
+	if (constant.type == Symbols::Int)
+		return constant.integer;
+
+	auto object = Heap::the().allocate<Object>(fetch_global_object(constant.type), constant.type);
+	if (constant.type == Symbols::Char)
+		object->add_store<StoreChar>(Symbols::value, constant.text.str()[0], false);
+	else
+		object->add_store<StoreLiteral>(Symbols::value, constant.text.str(), false);
+	object->make_literal();
+	return object;
+}
+
+void Interpreter::execute_load_global(uint32_t const *operands) {
+	store_at(operands[0], global_object(operands[1]));
+}
+
+void Interpreter::execute_load_local(uint32_t const *operands) {
+	auto &slot = local_slot(operands[1], operands[2]);
+	if (!slot)
+		terminating_error(StampError::ExecutionError, "Object not in scope: " + bytecode->symbol(operands[3]).str() + ".");
+	store_at(operands[0], *slot);
+}
+
+void Interpreter::execute_bind_global(uint32_t const *operands) {
+	global_frame->set(operands[0], as_object(at(operands[1])));
+}
+
+void Interpreter::execute_bind_local(uint32_t const *operands) {
+	local_slot(operands[0], operands[1]) = as_object(at(operands[2]));
+}
+
+void Interpreter::execute_send(uint32_t const *operands) {
+	auto msg = bytecode->symbol(operands[2]);
+	std::optional<std::variant<Register, Symbol, uint32_t>> stamp;
+	switch (static_cast<StampKind>(operands[3])) {
+		case StampKind::None:
+			break;
+		case StampKind::Register:
+			stamp = Register(operands[4]);
+			break;
+		case StampKind::Symbol:
+			stamp = bytecode->symbol(operands[4]);
+			break;
+		case StampKind::Block:
+			stamp = operands[4];
+			break;
+	}
+
+	auto &receiver = at(operands[1]);
+	auto object = std::get_if<Object*>(&receiver);
+	if (auto integer = std::get_if<int32_t>(&receiver)) {
+		auto result = send_unboxed_int(*integer, msg, stamp, *this);
+		if (result) {
+			store_at(operands[0], *result);
+			return;
 		}
+		// the Int object replaces the unboxed value so that further sends to the register reuse it
+		object = &receiver.emplace<Object*>(as_object(receiver));
+	}
+	if (object) {
+		store_at(operands[0], bytecode->inline_cache(operands[5]).send(*object, msg, stamp, *this));
+	} else {
+		terminating_error(StampError::ExecutionError, "Attempted to send to not an object.");
+	}
+}
+
+void Interpreter::execute_store(uint32_t const *operands) {
+	auto store_name = bytecode->symbol(operands[1]);
+	bool is_mutable = operands[3];
 
-		// remove all scopes that (lexically) end at the current basic block
-		while(true) {
-			if (!scopes.is_empty() && scopes.lexical_scopes.back()->ends_at(current_bb))
-				scopes.pop_scope();
+	auto &receiver = at(operands[0]);
+	auto object = std::get_if<Object*>(&receiver);
+	if (std::holds_alternative<int32_t>(receiver))
+		object = &receiver.emplace<Object*>(as_object(receiver));
+	if (object) {
+		auto &st_register = at(operands[2]);
+		auto st = std::get_if<Object*>(&st_register);
+		if (st)
+			(*object)->add_store<StoreObject>(store_name, *st, is_mutable);
+		else if (auto integer = std::get_if<int32_t>(&st_register))
+			(*object)->store_int(store_name, *integer, is_mutable);
+		else if (auto vec = std::get_if<std::vector<InternalStore*>*>(&st_register))
+			(*object)->add_store<StoreVec>(store_name, *vec, is_mutable);
+		else {
+			auto store = std::get<std::string>(st_register);
+			if (store == "default")
+				(*object)->add_default_store(store_name);
 			else
-				break;
+				(*object)->add_store<StoreLiteral>(store_name, store, is_mutable);
 		}
-		current_bb++;
+	} else {
+		terminating_error(StampError::ExecutionError, "Attempted to store to not an object.");
 	}
 }
 
-Object *Interpreter::fetch_object(std::string &name) {
-	for (auto context = scopes.contexts.rbegin(); context != scopes.contexts.rend(); context++) {
-		auto obj = (*context)->get(name);
-		if (obj)
-			return obj;
-	}
-	auto global_obj = fetch_global_object(name);
-	if (global_obj)
-		return global_obj;
-	terminating_error(StampError::ExecutionError, "Object not in scope: " + name + ".");
-	return nullptr;
+bool Interpreter::holds_global_object(uint32_t register_index, uint32_t slot) {
+	auto object = std::get_if<Object*>(&at(register_index));
+	return object && *object == global_frame->get(slot);
+}
+
+Object *Interpreter::fetch_global_object(Symbol name) {
+	auto slot = generator.get_bytecode().find_global(name);
+	auto obj = slot ? global_frame->get(*slot) : nullptr;
+	if (!obj)
+		terminating_error(StampError::ExecutionError, "Object not in scope: " + name.str() + ".");
+	return obj;
 }
 
-Object *Interpreter::fetch_global_object(std::string name) {
-	auto obj = global_scope.contexts[0]->get(name);
+Object *Interpreter::global_object(uint32_t slot) {
+	auto obj = global_frame->get(slot);
 	if (!obj)
-		terminating_error(StampError::ExecutionError, "Object not in scope: " + name + ".");
+		terminating_error(StampError::ExecutionError, "Object not in scope: " + generator.get_bytecode().global_name(slot).str() + ".");
 	return obj;
 }
 
-void Interpreter::dump() {
-	for (long unsigned int i = 0; i < reg_values.size(); i++) {
-		auto r = reg_values[i];
+Object *Interpreter::box_int(int32_t integer) {
+	auto object = Heap::the().allocate<Object>(int_prototype(), Symbols::Int);
+	object->add_store<StoreInt>(Symbols::value, integer, true);
+	return object;
+}
+
+Object *Interpreter::as_object(Value const &value) {
+	if (auto object = std::get_if<Object*>(&value))
+		return *object;
+	if (auto integer = std::get_if<int32_t>(&value))
+		return box_int(*integer);
+	terminating_error(StampError::ExecutionError, "Expected an object.");
+	return nullptr;
+}
+
+std::string Interpreter::to_string(Value const &value) {
+	if (auto str = std::get_if<std::string>(&value))
+		return *str;
+	if (auto integer = std::get_if<int32_t>(&value))
+		return std::to_string(*integer);
+	if (auto obj = std::get_if<Object*>(&value))
+		return *obj ? (*obj)->to_string() : "";
+	return StoreVec(std::get<std::vector<InternalStore*>*>(value), false).to_string();
+}
+
+std::optional<std::string> Interpreter::last_value(uint32_t first_register) {
+	// the last register is the scratch register
+	for (auto i = global_registers.size() - 1; i-- > first_register;) {
+		if (global_registers[i])
+			return to_string(*global_registers[i]);
+	}
+	return std::nullopt;
+}
+
+void Interpreter::clear_registers(uint32_t first_register) {
+	for (auto i = first_register; i < global_registers.size(); i++)
+		global_registers[i].reset();
+}
+
+void Interpreter::dump(uint32_t first_register) {
+	for (long unsigned int i = first_register; i < global_registers.size(); i++) {
+		auto r = global_registers[i];
 		std::cout << "r" << i << " ";
 
-		if (r) {
-			auto *str = std::get_if<std::string>(&*r);
-			if (str) {
-				std::cout << *str << "\n";
-			} else {
-				auto obj = std::get<Object *>(*r);
-				if (obj)
-					std::cout << obj->to_string();
-				std::cout << "\n";
-			}
-		} else {
+		if (r)
+			std::cout << to_string(*r) << "\n";
+		else
 			std::cout << "EMPTY\n";
-		}
 	}
-}
\ No newline at end of file
+}
+
+void Interpreter::dump_statistics() {
+	std::cout << "Global context size: " << global_frame->size() << "\n";
+	std::cout << "Call stack segments: " << calls.get_num_segments() << "\n";
+	Heap::the().dump_statistics();
+}
+
+void Interpreter::visit_roots(Heap &heap) {
+	auto mark_value = [&heap](Value const &value) {
+		if (auto object = std::get_if<Object*>(&value))
+			heap.mark(*object);
+		else if (auto vec = std::get_if<std::vector<InternalStore*>*>(&value))
+			heap.mark(VecStorage::from(*vec));
+	};
+	for (auto &value : global_registers) {
+		if (value)
+			mark_value(*value);
+	}
+	for (auto &value : constants) {
+		if (value)
+			mark_value(*value);
+	}
+	calls.for_each_value(mark_value);
+	heap.mark(global_frame);
+}
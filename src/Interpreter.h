@@ -8,11 +8,19 @@
 
 #include <vector>
 #include <string>
+#include <optional>
 #include <time.h>
 
 #include "Generator.h"
 #include "Object.h"
 #include "Context.h"
+#include "CallStack.h"
+
+// Computed goto is a GNU extension; building with -DSTAMP_SWITCH_DISPATCH (make DISPATCH=switch) selects the
+// portable switch-based dispatch loop instead.
+#if defined(__GNUC__) && !defined(STAMP_SWITCH_DISPATCH)
+#define STAMP_THREADED_DISPATCH
+#endif
 
 class Generator;
 class LexicalScope;
@@ -21,126 +29,119 @@ class Interpreter {
 public:
 	Interpreter(Generator &generator) : generator(generator) {
 		srand(time(nullptr));
+		Heap::the().add_roots(this);
+		reserve_registers();
+		make_global_frame();
 	}
+	Interpreter(Interpreter const &) = delete;
+	Interpreter &operator=(Interpreter const &) = delete;
+	~Interpreter() { Heap::the().remove_roots(this); }
 
-	void dump();
+	// registers outside of functions from first_register on
+	void dump(uint32_t first_register = 0);
+	void dump_statistics();
 
-	void run();
+	// marks everything the interpreter can still reach
+	void visit_roots(Heap &heap);
 
-	void store_at(uint32_t register_index, std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> value) {
-		// if register index is beyond the current allocated registers, fill the register vector
-		for (long unsigned int i = reg_values.size(); i < (long unsigned int) register_index; i++)
-			reg_values.push_back(std::nullopt);
+	void run();
+	// drops the calls of code that failed with an error, the next run continues after the blocks of that code
+	void abandon();
+
+	// value of the last register outside of functions from first_register on that holds one, as printed by dump
+	std::optional<std::string> last_value(uint32_t first_register);
+	// empties the registers outside of functions from first_register on, so the generator can hand them out again
+	void clear_registers(uint32_t first_register);
+
+	void set_max_call_depth(uint32_t depth) { calls.set_max_depth(depth); }
+
+	// registers outside of functions are allocated once per run and overwritten in place afterwards
+	void reserve_registers() {
+		// one more register than the generator handed out, used as a scratch register by default stores
+		if (calls.empty() && global_registers.size() < generator.get_num_registers() + 1) {
+			global_registers.resize(generator.get_num_registers() + 1);
+			set_register_window();
+		}
+	}
 
-		auto it = reg_values.begin() + register_index;
-		reg_values.insert(it, value);
+	void store_at(uint32_t register_index, Value value) {
+		registers[register_index] = std::move(value);
 	}
 
-	Register store_at_next_available(std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> value) {
-		auto next_register = generator.next_register();
-		auto it = reg_values.begin() + next_register.get_index();
-		reg_values.insert(it, value);
-		return next_register;
+	Register store_at_scratch(Value value) {
+		auto scratch = Register(num_registers - 1);
+		store_at(scratch.get_index(), std::move(value));
+		return scratch;
 	}
 
-	std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*> &at(uint32_t register_index) {
-		if (!reg_values[register_index])
+	// registers are numbered from the start of the registers of the function being executed
+	Value &at(uint32_t register_index) {
+		auto &value = registers[register_index];
+		if (!value)
 			terminating_error(StampError::ExecutionError, "Attempted to read an empty register: " + std::to_string(register_index) + ".");
-		return *reg_values[register_index];
+		return *value;
 	}
 
 	inline void jump_bb(uint32_t bb_index) {
-		current_bb = bb_index;
-		should_terminate_bb = true;
-	}
-
-	inline void save_next_bb() {
-		saved_bbs.push_back(current_bb + 1);
+		pc = bytecode->block_offset(bb_index);
 	}
 
-	inline void jump_saved_bb() {
-		uint32_t bb_index = saved_bbs[saved_bbs.size() - 1];
-		// remove all scopes that (lexically) end at the current basic block
-		while(true) {
-			if (!scopes.is_empty() && scopes.lexical_scopes.back()->ends_at(current_bb))
-				scopes.pop_scope();
-			else
-				break;
-		}
-		saved_bbs.pop_back();
-		jump_bb(bb_index);
-	}
+	Object *fetch_global_object(Symbol name);
+	Object *global_object(uint32_t slot);
 
-	void put_object(std::string name, Object *object) {
-		if (in_global_scope)
-			global_scope.contexts[0]->add(name, object);
-		else
-			scopes.contexts[scopes.contexts.size() - 1]->add(name, object);
-	}
+	Object *int_prototype() { return global_object(int_slot); }
+	Object *true_object() { return global_object(true_slot); }
+	Object *false_object() { return global_object(false_slot); }
 
-	void put_object_at_scope(std::string name, Object *object, uint32_t bb_index) {
-		for (unsigned long int i = 0; i < scopes.lexical_scopes.size(); i++) {
-			if (scopes.lexical_scopes[i]->starts_at(bb_index)) {
-				scopes.contexts[i]->add(name, object);
-			}
-		}
-		if (in_global_scope)
-			global_scope.contexts[0]->add(name, object);
-		else
-			scopes.contexts[scopes.contexts.size() - 1]->add(name, object);
-	}
-
-	void push_retval(std::optional<Register> ret) {
-		// FIXME: if this fails for some reason (e.g. multithreading), the data structure for return value should be changed
-		if (retval) {
-			terminating_error(StampError::ExecutionError, "A previous return value would be overwritten.");
-			return;
-		}
-		retval = ret;
-	}
-
-	std::optional<Register> pop_retval() {
-		auto ret = retval;
-		retval = {};
-		return ret;
-	}
-
-	Object *fetch_object(std::string &name);
-	Object *fetch_global_object(std::string name);
+	// materializes an unboxed Int as an Int object
+	Object *box_int(int32_t integer);
+	Object *as_object(Value const &value);
 private:
-	class Scopes {
-	public:
-		Scopes() {}
-
-		std::vector<LexicalScope*> lexical_scopes;
-		std::vector<Context*> contexts;
-
-		void add_scope(LexicalScope *lscope, Context *context) {
-			lexical_scopes.push_back(lscope);
-			contexts.push_back(context);
-		}
-
-		void add_lscope(LexicalScope *lscope) {
-			lexical_scopes.push_back(lscope);
-		}
-
-		void pop_scope() {
-			lexical_scopes.pop_back();
-			contexts.pop_back();
-		}
-
-		bool is_empty() {
-			return lexical_scopes.size() == 0;
-		}
-	};
+	friend class HeapImage;
+
+	void make_global_frame();
+	std::string to_string(Value const &value);
+	int32_t enclosing_frame(LexicalScope *function);
+	std::optional<Value> &local_slot(uint32_t depth, uint32_t slot);
+	// points the registers at the innermost call, or at the registers outside of functions
+	void set_register_window();
+
+	void run_switch();
+#ifdef STAMP_THREADED_DISPATCH
+	void run_threaded();
+#endif
+
+	void enter_block(uint32_t bb_index);
+	void exit_block(uint32_t bb_index);
+	void enter_frame(uint32_t scope_index, uint32_t frame_size);
+
+	void execute_load_const(uint32_t const *operands);
+	Value make_constant(Constant const &constant);
+	void execute_load_global(uint32_t const *operands);
+	void execute_load_local(uint32_t const *operands);
+	void execute_bind_global(uint32_t const *operands);
+	void execute_bind_local(uint32_t const *operands);
+	void execute_send(uint32_t const *operands);
+	void execute_store(uint32_t const *operands);
+	void execute_call(uint32_t const *operands, bool is_tail_call);
+	void execute_return(uint32_t const *operands);
+	// whether a register holds the global in a slot, e.g. True for a JumpTrue
+	bool holds_global_object(uint32_t register_index, uint32_t slot);
 
-	bool should_terminate_bb = { false };
 	uint32_t current_bb = { 0 };
+	// offset of the next instruction in the bytecode
+	uint32_t pc = { 0 };
+	Bytecode *bytecode = { nullptr };
 	Generator &generator;
-	std::vector<std::optional<std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*>>> reg_values;
-	Scopes scopes;
-	Scopes global_scope;
-	bool in_global_scope = { false };
-	std::vector<uint32_t> saved_bbs;
-	std::optional<Register> retval;
-};
\ No newline at end of file
+	std::vector<std::optional<Value>> global_registers;
+	// values of the generator's constants, made the first time they are loaded
+	std::vector<std::optional<Value>> constants;
+	CallStack calls;
+	// registers of the code being executed, the last of them is the scratch register
+	std::optional<Value> *registers = { nullptr };
+	uint32_t num_registers = { 0 };
+	Context *global_frame = { nullptr };
+	uint32_t int_slot = { 0 };
+	uint32_t true_slot = { 0 };
+	uint32_t false_slot = { 0 };
+};
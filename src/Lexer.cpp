@@ -4,229 +4,207 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algorithm>
 #include <string>
-#include <iostream>
-#include <sstream>
-#include <cstring>
-#include <cctype>
+#include <string_view>
 
 #include "Lexer.h"
 #include "Token.h"
 #include "Error.h"
 
-char token_image[MAX_TOKEN_LEN];
+// the same as the C locale's classes, without going through the locale for every character
+static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_name(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_'; }
 
-char scan_char(std::string &raw_string, long unsigned int *position) {
-	return raw_string[++(*position)];
+static int hex_digit(char c) {
+	if (is_digit(c)) return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
 }
 
-Token scan(std::string &raw_string, long unsigned int *position, std::string &file, size_t line) {
-#define next_char scan_char(raw_string, position)
-	int c = raw_string[*position];
-	int i = 0;
-
-	while (isspace(c)) c = next_char;
+void Lexer::skip_space() {
+	while (true) {
+		while (position < text.size() && is_space(text[position]))
+			position++;
+		if (peek() != '/')
+			return;
+		if (peek(1) == '/') {
+			auto end = text.find('\n', position);
+			position = end == std::string_view::npos ? text.size() : end;
+		} else if (peek(1) == '*') {
+			auto end = text.find("*/", position + 2);
+			if (end == std::string_view::npos)
+				// FIXME: change to hinting error when we implement error recovery
+				fail(position, "Unmatched multiline comment start.");
+			position = end + 2;
+		} else
+			return;
+	}
+}
 
-	size_t column = *position;
-	if (c == '\0') return Token(Token::Eof, file, line, column);
+Token Lexer::next() {
+	skip_space();
 
+	auto start = position;
 	bool is_message = false;
-	if (c == '.') {
-		c = next_char;
+	if (peek() == '.') {
+		position++;
 		is_message = true;
 	}
 
+	auto token = [&](Token::TokenType type, uint32_t length) {
+		position += length;
+		return Token(type, source, start);
+	};
+	auto message = [&](uint32_t length) {
+		auto value = text.substr(position, length);
+		position += length;
+		return Token(Token::Message, value, source, start);
+	};
+
+	char c = peek();
+	if (c == '\0') return Token(Token::Eof, source, start);
+
 	switch (c) {
-		case ';': next_char; return Token(Token::StatementEnd, file, line, column);
-		case '{': next_char; return Token(Token::SListBegin, file, line, column);
-		case '}': next_char; return Token(Token::SListEnd, file, line, column);
-		case '(': next_char; return Token(Token::OpenParend, file, line, column);
-		case ')': next_char; return Token(Token::CloseParend, file, line, column);
-		case ',': next_char; return Token(Token::Coma, file, line, column);
-		case '[': next_char; return Token(Token::SqBracketL, file, line, column);
-		case ']': next_char; return Token(Token::SqBracketR, file, line, column);
-		case '^': next_char; return Token(Token::Message, "clone", file, line, column);
-		case '%': next_char; return Token(Token::Message, "%", file, line, column);
-		case '+': next_char; return Token(Token::Message, "+", file, line, column);
-		case '-': next_char; return Token(Token::Message, "-", file, line, column);
-		case '/': {
-			c = next_char;
-			switch (c) {
-				case '/': next_char; return Token(Token::SlashSlash, file, line, column);
-				case '*': next_char; return Token(Token::SlashStar, file, line, column);
-				default: return Token(Token::Message, "/", file, line, column);
-			}
-		}
+		case ';': return token(Token::StatementEnd, 1);
+		case '{': return token(Token::SListBegin, 1);
+		case '}': return token(Token::SListEnd, 1);
+		case '(': return token(Token::OpenParend, 1);
+		case ')': return token(Token::CloseParend, 1);
+		case ',': return token(Token::Coma, 1);
+		case '[': return token(Token::SqBracketL, 1);
+		case ']': return token(Token::SqBracketR, 1);
+		case '^': position++; return Token(Token::Message, "clone", source, start);
+		case '%':
+		case '+':
+		case '-':
+		case '/': return message(1);
 		case '*': {
-			c = next_char;
-			switch (c) {
-				case '/': next_char; return Token(Token::StarSlash, file, line, column);
-				default: return Token(Token::Message, "*", file, line, column);
-			}
-		}
-		case '<': {
-			c = next_char;
-			switch (c) {
-				case '<': next_char; return Token(Token::Message, "<<", file, line, column);
-				case '=': next_char; return Token(Token::Message, "<=", file, line, column);
-				default: return Token(Token::Message, "<", file, line, column);
-			}
-		}
-		case '>': {
-			c = next_char;
-			switch (c) {
-				case '>': next_char; return Token(Token::Message, ">>", file, line, column);
-				case '=': next_char; return Token(Token::Message, ">=", file, line, column);
-				case '<': next_char; return Token(Token::Message, "><", file, line, column);
-				default: return Token(Token::Message, ">", file, line, column);
-			}
-		}
-		case '!': {
-			c = next_char;
-			if (c == '=') {
-				next_char; return Token(Token::Message, "!=", file, line, column);
+			switch (peek(1)) {
+				case '/': return token(Token::StarSlash, 2);
+				default: return message(1);
 			}
-			return Token(Token::Message, "!", file, line, column);
-		}
-		case '&': {
-			c = next_char;
-			if (c == '&') {
-				next_char; return Token(Token::Message, "&&", file, line, column);
-			}
-			return Token(Token::Message, "&", file, line, column);
 		}
+		case '<': return message(peek(1) == '<' || peek(1) == '=' ? 2 : 1);
+		case '>': return message(peek(1) == '>' || peek(1) == '=' || peek(1) == '<' ? 2 : 1);
+		case '!': return message(peek(1) == '=' ? 2 : 1);
+		case '&': return message(peek(1) == '&' ? 2 : 1);
 		case '|': {
-			c = next_char;
-			if (c == '=') {
-				next_char; return Token(Token::Message, "||", file, line, column);
+			if (peek(1) == '=') {
+				position += 2;
+				return Token(Token::Message, "||", source, start);
 			}
-			return Token(Token::Message, "|", file, line, column);
+			return message(1);
 		}
 		case '=': {
-			c = next_char;
-			if (c == '=') {
-				next_char;
-				return Token(Token::Message, "==", file, line, column);
-			}
-			return Token(Token::Store, file, line, column);
+			if (peek(1) == '=')
+				return message(2);
+			return token(Token::Store, 1);
 		}
 		case '\'': {
-			char ch = next_char;
-			// (Most) escape sequences from https://en.wikipedia.org/wiki/Escape_sequences_in_C
-			if (ch == '\\') {
-				char esc = next_char;
-				switch (esc) {
-					case 'a': ch = '\a'; break;
-					case 'b': ch = '\b'; break;
-					case 'e': ch = static_cast<char>(0x1b); break;
-					case 'f': ch = '\f'; break;
-					case 'n': ch = '\n'; break;
-					case 'r': ch = '\r'; break;
-					case 't': ch = '\t'; break;
-					case 'v': ch = '\v'; break;
-					case '\\': ch = '\\'; break;
-					case '\'': ch = '\''; break;
-					case '\"': ch = '\"'; break;
-					case '\?': ch = '\?'; break;
-					case 'x': {
-						// FIXME: Only reads "proper" characters (of hex length 2), maybe should support lengths 1, 3 and beyond?
-						char num[] = {next_char, next_char};
-						std::stringstream s;
-						int hex;
-						s << std::hex << num;
-						s >> hex;
-						ch = static_cast<char>(hex);
-						break;
-					}
-					// FIXME: Unicode (\u) support?
-					default: ch = esc; break;
-				}
+			position++;
+			std::string_view value;
+			if (peek() == '\\') {
+				auto ch = static_cast<char*>(arena->allocate(1, 1));
+				*ch = unescape();
+				value = std::string_view(ch, 1);
+			} else {
+				value = text.substr(position, 1);
+				position += value.size();
 			}
-			auto tok =  Token(Token::Char, std::string{ch}, file, line, column);
-			c = next_char;
-			next_char;
-			if (c != '\'')
+			if (peek() != '\'')
 				// FIXME: change to hinting error when we implement error recovery
-				terminating_error(StampError::LexingError, file + ":" + std::to_string(line) + ":" + std::to_string(column) + ": Length of character is not valid.");
-			return tok;
+				fail(start, "Length of character is not valid.");
+			position++;
+			return Token(Token::Char, value, source, start);
 		}
 		case '\"': {
-			c = next_char;
-			do {
-				if (c == '\\') {
-					char esc = next_char;
-					switch (esc) {
-						case 'a': c = '\a'; break;
-						case 'b': c = '\b'; break;
-						case 'e': c = static_cast<char>(0x1b); break;
-						case 'f': c = '\f'; break;
-						case 'n': c = '\n'; break;
-						case 'r': c = '\r'; break;
-						case 't': c = '\t'; break;
-						case 'v': c = '\v'; break;
-						case '\\': c = '\\'; break;
-						case '\'': c = '\''; break;
-						case '\"': c = '\"'; break;
-						case '\?': c = '\?'; break;
-						case 'x': {
-							// FIXME: Only reads "proper" characters (of hex length 2), maybe should support lengths 1, 3 and beyond?
-							char num[] = {next_char, next_char};
-							std::stringstream s;
-							int hex;
-							s << std::hex << num;
-							s >> hex;
-							c = static_cast<char>(hex);
-							break;
-						}
-							// FIXME: Unicode (\u) support?
-						default: c = esc; break;
-					}
-				}
-				token_image[i++] = c;
-				if (i >= MAX_TOKEN_LEN)
-					// FIXME: change to hinting error when we implement error recovery
-					terminating_error(StampError::LexingError, file + ":" + std::to_string(line) + ":" + std::to_string(column) + ": Maximum token length exceeded.");
-				c = next_char;
-			} while (c != '\"');
-			token_image[i] = '\0';
-			next_char;
-
-			return Token(Token::String, token_image, file, line, column);
+			position++;
+			return Token(Token::String, string_literal(start), source, start);
 		}
 		default: {
-			if (isdigit(c)) {
-				do {
-					token_image[i++] = c;
-					if (i >= MAX_TOKEN_LEN)
-						// FIXME: change to hinting error when we implement error recovery
-						terminating_error(StampError::LexingError, file + ":" + std::to_string(line) + ":" + std::to_string(column) + ": Maximum token length exceeded.");
-					c = next_char;
-				} while (isdigit(c));
-				token_image[i] = '\0';
-				return Token(Token::Int, token_image, file, line, column);
-			} else {
-				do {
-					token_image[i++] = c;
-					if (i >= MAX_TOKEN_LEN)
-						// FIXME: change to hinting error when we implement error recovery
-						terminating_error(StampError::LexingError, file + ":" + std::to_string(line) + ":" + std::to_string(column) + ": Maximum token length exceeded.");
-					c = next_char;
-				} while (isalpha(c) || isdigit(c) || c == '_');
-				token_image[i] = '\0';
-
-				if (token_image == std::string("fn")) return Token(Token::Fn, file, line, column);
-				if (token_image == std::string("if")) return Token(Token::If, file, line, column);
-				if (token_image == std::string("else")) return Token(Token::Else, file, line, column);
-				if (token_image == std::string("while")) return Token(Token::While, file, line, column);
-				if (token_image == std::string("break")) return Token(Token::Break, file, line, column);
-				if (token_image == std::string("continue")) return Token(Token::Continue, file, line, column);
-				if (token_image == std::string("mut")) return Token(Token::Mut, file, line, column);
-				if (token_image == std::string("use")) return Token(Token::Use, file, line, column);
-				if (token_image == std::string("return")) return Token(Token::Return, file, line, column);
-				if (token_image[0] >= 65 && token_image[0] <= 90) return Token(Token::Object, token_image, file, line, column);
-				return Token(is_message ? Token::Message : Token::Value, token_image, file, line, column);
+			auto begin = position;
+			if (is_digit(c)) {
+				while (is_digit(peek()))
+					position++;
+				return Token(Token::Int, text.substr(begin, position - begin), source, start);
 			}
+
+			do {
+				position++;
+			} while (is_name(peek()));
+			auto value = text.substr(begin, position - begin);
+
+			if (value == "fn") return Token(Token::Fn, source, start);
+			if (value == "if") return Token(Token::If, source, start);
+			if (value == "else") return Token(Token::Else, source, start);
+			if (value == "while") return Token(Token::While, source, start);
+			if (value == "break") return Token(Token::Break, source, start);
+			if (value == "continue") return Token(Token::Continue, source, start);
+			if (value == "mut") return Token(Token::Mut, source, start);
+			if (value == "use") return Token(Token::Use, source, start);
+			if (value == "return") return Token(Token::Return, source, start);
+			if (value[0] >= 'A' && value[0] <= 'Z') return Token(Token::Object, value, source, start);
+			return Token(is_message ? Token::Message : Token::Value, value, source, start);
+		}
+	}
+}
+
+// reads the escape sequence at position
+char Lexer::unescape() {
+	// (Most) escape sequences from https://en.wikipedia.org/wiki/Escape_sequences_in_C
+	char escape = peek(1);
+	position = std::min<uint32_t>(position + 2, text.size());
+	switch (escape) {
+		case 'a': return '\a';
+		case 'b': return '\b';
+		case 'e': return static_cast<char>(0x1b);
+		case 'f': return '\f';
+		case 'n': return '\n';
+		case 'r': return '\r';
+		case 't': return '\t';
+		case 'v': return '\v';
+		case 'x': {
+			// FIXME: Only reads "proper" characters (of hex length 2), maybe should support lengths 1, 3 and beyond?
+			int value = 0;
+			for (int i = 0; i < 2 && hex_digit(peek()) >= 0; i++)
+				value = value * 16 + hex_digit(text[position++]);
+			return static_cast<char>(value);
 		}
+		// FIXME: Unicode (\u) support?
+		default: return escape;
 	}
-#undef next_char
-}
\ No newline at end of file
+}
+
+// the contents of the string literal at position, which are unescaped into the arena only if they need to be
+std::string_view Lexer::string_literal(uint32_t start) {
+	auto begin = position;
+	bool is_escaped = false;
+	while (peek() != '\"') {
+		if (at_end())
+			// FIXME: change to hinting error when we implement error recovery
+			fail(start, "Unterminated string.");
+		if (text[position] == '\\') {
+			is_escaped = true;
+			position++;
+		}
+		position++;
+	}
+	auto end = position++;
+	if (!is_escaped)
+		return text.substr(begin, end - begin);
+
+	auto after = position;
+	auto unescaped = static_cast<char*>(arena->allocate(end - begin, 1));
+	uint32_t length = 0;
+	for (position = begin; position < end;)
+		unescaped[length++] = text[position] == '\\' ? unescape() : text[position++];
+	position = after;
+	return std::string_view(unescaped, length);
+}
+
+void Lexer::fail(uint32_t offset, std::string const &error) const {
+	terminating_error(StampError::LexingError, source->position(offset) + ": " + error);
+}
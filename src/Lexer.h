@@ -6,10 +6,36 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
+#include "Arena.h"
+#include "Source.h"
 #include "Token.h"
 
-static const int MAX_TOKEN_LEN = 128;
+// Scans a source into tokens, skipping comments. Token values are views into the source's text, apart from string
+// and character literals with escape sequences, which are unescaped into the arena; so both have to outlive the
+// tokens. A lexer keeps all of its state, so files can be scanned on several threads at once.
+class Lexer {
+public:
+	Lexer(Source const &source, Arena &arena) : source(&source), text(source.get_text()), arena(&arena) {}
 
-Token scan(std::string &raw_string, long unsigned int *position, std::string &file, size_t line);
\ No newline at end of file
+	Token next();
+
+	bool at_end() const { return position >= text.size(); }
+	uint32_t get_position() const { return position; }
+private:
+	char peek(uint32_t ahead = 0) const {
+		return position + ahead < text.size() ? text[position + ahead] : '\0';
+	}
+	void skip_space();
+	char unescape();
+	std::string_view string_literal(uint32_t start);
+	[[noreturn]] void fail(uint32_t offset, std::string const &error) const;
+
+	Source const *source;
+	std::string_view text;
+	Arena *arena;
+	uint32_t position = { 0 };
+};
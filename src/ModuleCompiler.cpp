@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+// FIXME: only works on unix systems
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ModuleCompiler.h"
+#include "Generator.h"
+#include "Parser.h"
+#include "Error.h"
+
+std::unordered_map<std::string, std::unique_ptr<ObjectFileReader>> ModuleCompiler::compile(std::vector<std::string> const &names) {
+	std::unordered_map<std::string, std::unique_ptr<ObjectFileReader>> modules;
+	std::deque<std::string> queue;
+	for (auto const &name : names) {
+		auto path = real_path(dirs, name);
+		if (modules.emplace(path, nullptr).second)
+			queue.push_back(path);
+	}
+
+	std::mutex mutex;
+	std::condition_variable work_changed;
+	uint32_t num_busy = 0;
+	std::exception_ptr error;
+
+	// threads are started as there are modules for them, the calling thread is one of them
+	std::vector<std::thread> threads;
+	std::function<void()> work;
+	auto start_threads = [&]() {
+		while (!error && threads.size() + 1 < num_threads && threads.size() + 1 < num_busy + queue.size())
+			threads.emplace_back(work);
+	};
+
+	work = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			work_changed.wait(lock, [&]() { return !queue.empty() || num_busy == 0 || error; });
+			if (error || queue.empty())
+				return;
+			auto path = queue.front();
+			queue.pop_front();
+			num_busy++;
+			lock.unlock();
+
+			std::unique_ptr<ObjectFileReader> module;
+			std::vector<std::string> used_paths;
+			std::exception_ptr failure;
+			try {
+				std::vector<std::string> uses;
+				module = compile_module(dirs, path, uses);
+				for (auto const &use : uses)
+					used_paths.push_back(real_path(dirs, use));
+			} catch (...) {
+				failure = std::current_exception();
+			}
+
+			lock.lock();
+			num_busy--;
+			if (failure && !error)
+				error = failure;
+			modules[path] = std::move(module);
+			for (auto const &used_path : used_paths) {
+				if (modules.emplace(used_path, nullptr).second)
+					queue.push_back(used_path);
+			}
+			start_threads();
+			work_changed.notify_all();
+		}
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		start_threads();
+	}
+	work();
+	for (auto &thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+	return modules;
+}
+
+std::string ModuleCompiler::find_source(std::vector<std::string> const &dirs, std::string const &name) {
+	std::string resolved_filename;
+	if (name.find(".stamp") != std::string::npos)
+		resolved_filename = name;
+	else
+		resolved_filename = name + ".stamp";
+	for (auto const &dir : dirs) {
+		// FIXME: only works on unix systems
+		auto temp = dir + "/" + resolved_filename;
+		std::ifstream test(temp);
+		if (test.good())
+			return temp;
+	}
+
+	std::ifstream test(resolved_filename);
+	if (!test.good())
+		terminating_error(StampError::FileParsingError, "Cannot find file to use: " + name + ".");
+	return resolved_filename;
+}
+
+std::string ModuleCompiler::real_path(std::vector<std::string> const &dirs, std::string const &name) {
+	// FIXME: only works on unix systems
+	char path[PATH_MAX];
+	if (!realpath(find_source(dirs, name).c_str(), path))
+		terminating_error(StampError::FileParsingError, "Cannot find file to use: " + name + ".");
+	return path;
+}
+
+std::unique_ptr<ObjectFileReader> ModuleCompiler::compile_module(std::vector<std::string> const &dirs, std::string const &path,
+		std::vector<std::string> &uses) {
+	// FIXME: only works on unix systems
+	auto slash = path.rfind('/');
+	auto cache_dir = path.substr(0, slash) + "/.stamp-cache";
+	auto name = path.substr(slash + 1);
+	auto cache = cache_dir + "/" + name.substr(0, name.rfind(".stamp")) + ".ostamp";
+
+	struct stat source_stat;
+	if (stat(path.c_str(), &source_stat) < 0)
+		terminating_error(StampError::FileParsingError, "Cannot find file to use: " + path + ".");
+	uint64_t size = source_stat.st_size;
+	int64_t mtime = (int64_t)source_stat.st_mtim.tv_sec * 1000000000 + source_stat.st_mtim.tv_nsec;
+
+	std::unique_ptr<Source> source;
+	auto checksum = [&source, &path]() {
+		if (!source)
+			source = Source::from_file(path, path);
+		auto text = source->get_text();
+		return ObjectFile::checksum(reinterpret_cast<uint8_t const*>(text.data()), text.size());
+	};
+
+	try {
+		auto file = std::make_unique<ObjectFileReader>(cache);
+		auto record = file->is_open() ? file->source() : nullptr;
+		if (record && file->symbol(record->path).str() == path && record->size == size
+				&& (record->mtime == mtime || record->checksum == checksum())) {
+			for (uint32_t i = 0; i < file->get_num_uses(); i++)
+				uses.push_back(file->symbol(file->use(i).name).str());
+			return file;
+		}
+	} catch (StampException const &) {
+		// caches written for another version or damaged ones are compiled again
+	}
+
+	// the module is compiled on its own, the modules it uses are linked whenever it is
+	Generator module(dirs);
+	module.module_source = Generator::ModuleSource { Symbol::intern(path), checksum(), size, mtime };
+	if (auto ast = Parser(module.add_source(std::move(source)), &module).parse_program())
+		ast->generate_bytecode(module);
+	for (auto const &[used, block] : module.module_uses)
+		uses.push_back(used.str());
+
+	// written next to the cache and moved over it, so that other processes never see half of it
+	mkdir(cache_dir.c_str(), 0777);
+	auto temp = cache + "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	try {
+		module.write_to_file(temp);
+	} catch (StampException const &) {
+		unlink(temp.c_str());
+		return nullptr;
+	}
+	if (rename(temp.c_str(), cache.c_str()) < 0) {
+		unlink(temp.c_str());
+		return nullptr;
+	}
+	return std::make_unique<ObjectFileReader>(cache);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ObjectFile.h"
+
+// Compiles modules into their caches (see Generator::use_module) on a pool of threads. The modules a module uses are
+// found as it is compiled, or read from its cache, and compiled alongside the others. A module does not need the
+// modules it uses to compile, so the time taken follows the longest chain of uses rather than the number of modules.
+class ModuleCompiler {
+public:
+	explicit ModuleCompiler(std::vector<std::string> const &dirs, unsigned num_threads = std::thread::hardware_concurrency())
+		: dirs(dirs), num_threads(num_threads ? num_threads : 1) {}
+
+	// Up to date caches of the modules and of all modules they use, by real path, nullptr for the modules whose cache
+	// cannot be written. Fails with the error of a module that does not compile once the other threads are done.
+	std::unordered_map<std::string, std::unique_ptr<ObjectFileReader>> compile(std::vector<std::string> const &names);
+
+	// path of the source file a use or include refers to, found in dirs
+	static std::string find_source(std::vector<std::string> const &dirs, std::string const &name);
+	// the same for every path that refers to the file, which is what modules are known by
+	static std::string real_path(std::vector<std::string> const &dirs, std::string const &name);
+	// up to date cache of a module, compiled if needed, nullptr if it cannot be written; uses are the modules it uses
+	static std::unique_ptr<ObjectFileReader> compile_module(std::vector<std::string> const &dirs, std::string const &path,
+			std::vector<std::string> &uses);
+private:
+	std::vector<std::string> dirs;
+	unsigned num_threads;
+};
@@ -9,44 +9,96 @@
 #include "DefaultStores.h"
 #include "Object.h"
 #include "Interpreter.h"
+#include "InlineCache.h"
 
-std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*>
-        Object::send(std::string message, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Object *forwarder, Interpreter &interpreter) {
-	if (is_default_store(message)) {
-		return default_stores_map[message](forwarder ? forwarder : this, stamp, interpreter);
-	}
-	if (stores.count(message)) {
+static Value unwrap_store(InternalStore *store) {
 #define __UNWRAP_STORE(t, c) \
-		case InternalStore::Type::t: return static_cast<c*>(stores[message])->unwrap();
-		switch(stores[message]->get_type()) {
-			ENUMERATE_STORE_TYPES(__UNWRAP_STORE)
-		}
-#undef __UNWRAP_STORE
-	} else {
-		if (prototype)
-			return prototype->send(message, stamp, this, interpreter);
-		else {
-			terminating_error(StampError::ExecutionError, message + " store not found in " + (forwarder ? forwarder->get_type() : type) + ".");
-		}
+		case InternalStore::Type::t: return static_cast<c*>(store)->unwrap();
+	switch(store->get_type()) {
+		ENUMERATE_STORE_TYPES(__UNWRAP_STORE)
 	}
-	terminating_error(StampError::ExecutionError, message + " store not found in " + (forwarder ? forwarder->get_type() : type) + ".");
+#undef __UNWRAP_STORE
+	terminating_error(StampError::ExecutionError, "Unable to unwrap store.");
 	Object *error = nullptr;
 	return error;
 }
 
+Lookup Object::lookup(Symbol message) {
+	for (auto object = this; object; object = object->get_prototype()) {
+		if (object->shape->has_default_store(message))
+			return Lookup { object, nullptr, true };
+		auto index = object->shape->slot_of(message);
+		if (index >= 0)
+			return Lookup { object, object->slot(index), false };
+	}
+	return Lookup {};
+}
+
+Value
+        Object::apply(Lookup const &lookup, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	if (lookup.is_default)
+		return default_stores_map[message.get_id()](this, stamp, interpreter);
+	return unwrap_store(lookup.store);
+}
+
+Value
+        Object::send(Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Object *forwarder, Interpreter &interpreter) {
+	auto receiver = forwarder ? forwarder : this;
+	auto found = lookup(message);
+	if (!found) {
+		terminating_error(StampError::ExecutionError, message.str() + " store not found in " + receiver->get_type().str() + ".");
+		Object *error = nullptr;
+		return error;
+	}
+	return receiver->apply(found, message, stamp, interpreter);
+}
+
+std::optional<Value> send_unboxed_int(int32_t receiver, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter) {
+	if (message == Symbols::value)
+		return receiver;
+	if (!interpreter.int_prototype()->is_default_store(message) || !stamp || !std::holds_alternative<Register>(*stamp))
+		return std::nullopt;
+	auto other = int_of(interpreter.at(std::get<Register>(*stamp).get_index()));
+	if (!other)
+		return std::nullopt;
+	return int_operation(message, receiver, *other, interpreter);
+}
+
+void Object::invalidate_inline_caches() {
+	InlineCache::invalidate_all();
+}
+
+void Object::add_default_store(Symbol store) {
+	if (literal) {
+		terminating_error(StampError::ExecutionError, "Cannot add default store " + store.str() + " to literal " + type.str() + ".");
+		return;
+	}
+	if (store.get_id() >= default_stores_map.size() || !default_stores_map[store.get_id()])
+		terminating_error(StampError::ExecutionError, "There is no default store " + store.str() + " to add to object " + type.str() + ".");
+	shape = shape->with_default_store(store);
+	if (is_prototype())
+		invalidate_inline_caches();
+}
+
 std::string Object::to_string() const {
 	std::stringstream s;
-	if (type == "True")
+	if (type == Symbols::True)
 		s << "True";
-	else if (type == "False")
+	else if (type == Symbols::False)
 		s << "False";
-	else if (stores.count("value")) {
-		s << const_cast<const InternalStore*>(stores.at("value"))->to_string();
+	else if (shape->slot_of(Symbols::value) >= 0) {
+		s << const_cast<const InternalStore*>(slot(shape->slot_of(Symbols::value)))->to_string();
 	} else
-		s << type << "-" << std::hex << hash;
+		s << type.str() << "-" << std::hex << hash;
 	return s.str();
 }
 
+void Object::visit_edges(Heap &heap) {
+	heap.mark(get_prototype());
+	for (uint32_t i = 0; i < shape->get_num_slots(); i++)
+		heap.mark(slot(i));
+}
+
 std::string InternalStore::to_string() const {
 #define __UNWRAP_STORE(t, c) \
 		case InternalStore::Type::t: return static_cast<c const&>(*this).to_string();
@@ -61,4 +113,8 @@ std::string InternalStore::to_string() const {
 
 std::string StoreObject::to_string() const {
 	return object->to_string();
-}
\ No newline at end of file
+}
+
+void StoreObject::visit_edges(Heap &heap) {
+	heap.mark(object);
+}
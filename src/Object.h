@@ -8,17 +8,19 @@
 
 #include <algorithm>
 #include <string>
-#include <set>
 #include <optional>
-#include <map>
 #include <variant>
 #include <vector>
 #include <sstream>
 
 #include "Register.h"
+#include "Symbol.h"
+#include "Shape.h"
+#include "Heap.h"
 #include "Error.h"
 
 class Object;
+class InternalStore;
 class StoreObject;
 class StoreLiteral;
 class StoreInt;
@@ -27,6 +29,9 @@ class StoreVec;
 class StoreRegister;
 class Interpreter;
 
+// Value held by a register. Ints are kept unboxed as int32_t and only become Int objects when an object is needed.
+using Value = std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*>;
+
 #define ENUMERATE_STORE_TYPES(T)       \
 	T(StoreObject, StoreObject)        \
 	T(StoreLiteral, StoreLiteral)      \
@@ -35,7 +40,7 @@ class Interpreter;
 	T(StoreVec, StoreVec)              \
 	T(StoreRegister, StoreRegister)
 
-class InternalStore {
+class InternalStore : public Cell {
 public:
 	enum class Type {
 #define __STORE_TYPES(t, c) \
@@ -60,6 +65,8 @@ public:
 
 	Object *unwrap() const { return object; }
 	std::string to_string() const;
+
+	void visit_edges(Heap &heap) override;
 private:
 	Object *object;
 };
@@ -79,6 +86,7 @@ public:
 	StoreInt(int32_t integer, bool is_mutable) : InternalStore(Type::StoreInt, is_mutable), integer(integer) {}
 
 	int32_t unwrap() const { return integer; }
+	void set(int32_t value) { integer = value; }
 	std::string to_string() const { return std::to_string(integer); }
 private:
 	int32_t integer;
@@ -94,6 +102,18 @@ private:
 	char c;
 };
 
+// Elements of a Vec. Shared between the StoreVec holding it and any register it was read into.
+class VecStorage : public Cell, public std::vector<InternalStore*> {
+public:
+	void visit_edges(Heap &heap) override {
+		for (auto element : *this)
+			heap.mark(element);
+	}
+
+	// every vector handed out to the interpreter is allocated as VecStorage
+	static VecStorage *from(std::vector<InternalStore*> *vec) { return static_cast<VecStorage*>(vec); }
+};
+
 class StoreVec : public InternalStore {
 public:
 	StoreVec(std::vector<InternalStore*> *vec, bool is_mutable) : InternalStore(Type::StoreVec, is_mutable), vec(vec) {}
@@ -111,6 +131,8 @@ public:
 		s << "]";
 		return s.str();
 	}
+
+	void visit_edges(Heap &heap) override { heap.mark(VecStorage::from(vec)); }
 private:
 	std::vector<InternalStore*> *vec;
 };
@@ -119,53 +141,118 @@ class StoreRegister : public InternalStore {
 public:
 	StoreRegister(uint32_t reg_index, bool is_mutable) : InternalStore(Type::StoreRegister, is_mutable), reg_index(reg_index) {}
 
-	uint32_t unwrap() { return reg_index; }
+	// returned as int32_t so that it converts unambiguously into the register variant
+	int32_t unwrap() { return reg_index; }
 	std::string to_string() const { return "r" + std::to_string(reg_index); }
 private:
 	uint32_t reg_index;
 };
 
-class Object {
+// Where a message sent to an object resolves to: either a store or a default store of the holder object.
+struct Lookup {
+	Object *holder = { nullptr };
+	InternalStore *store = { nullptr };
+	bool is_default = { false };
+
+	explicit operator bool() const { return holder != nullptr; }
+};
+
+class Object : public Cell {
 public:
-	Object(Object *prototype, std::string type) : prototype(prototype), type(type) {
+	Object(Object *prototype, Symbol type) : type(type), shape(Shape::root_for(prototype)) {
 		hash = rand();
 	}
+	// shapes derived from this object are only used by objects that keep it alive
+	~Object() { delete derived_shape; }
+
+	Value
+	        send(Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Object *forwarder, Interpreter &interpreter);
+	Value
+	        apply(Lookup const &lookup, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter);
 
-	std::variant<Object *, std::string, int32_t, std::vector<InternalStore*>*>
-	        send(std::string message, std::optional<std::variant<Register, std::string, uint32_t>> stamp, Object *forwarder, Interpreter &interpreter);
+	Lookup lookup(Symbol message);
 
 	template<class T, typename... Args>
-	void add_store(std::string store_name, Args&&... args) {
-		if (!stores.empty() && stores.count(store_name) && !stores[store_name]->is_mutable()) {
-			terminating_error(StampError::ExecutionError, "Cannot assign to immutable store " + store_name + " in object " + type + ".");
+	void add_store(Symbol store_name, Args&&... args) {
+		auto index = shape->slot_of(store_name);
+		if (index >= 0 && !slot(index)->is_mutable()) {
+			terminating_error(StampError::ExecutionError, "Cannot assign to immutable store " + store_name.str() + " in object " + type.str() + ".");
+			return;
+		}
+		if (literal) {
+			terminating_error(StampError::ExecutionError, "Cannot add store " + store_name.str() + " to literal " + type.str() + ".");
+			return;
+		}
+
+		auto store = static_cast<InternalStore*>(Heap::the().allocate<T>(std::forward<Args>(args)...));
+		if (index >= 0) {
+			slot(index) = store;
 		} else {
-			stores[store_name] = static_cast<InternalStore*>(new T(std::forward<Args>(args)...));
+			shape = shape->with_store(store_name);
+			if (shape->get_num_slots() <= INLINE_SLOTS)
+				inline_slots[shape->get_num_slots() - 1] = store;
+			else
+				overflow_slots.push_back(store);
 		}
+		if (is_prototype())
+			invalidate_inline_caches();
 	}
 
-	InternalStore *get_store(std::string store_name) {
-		if (stores.count(store_name))
-			return stores[store_name];
+	// overwrites a mutable Int store in place instead of allocating a new one
+	void store_int(Symbol store_name, int32_t value, bool is_mutable) {
+		auto index = shape->slot_of(store_name);
+		if (is_mutable && index >= 0 && slot(index)->is_mutable() && slot(index)->get_type() == InternalStore::Type::StoreInt) {
+			static_cast<StoreInt*>(slot(index))->set(value);
+			return;
+		}
+		add_store<StoreInt>(store_name, value, is_mutable);
+	}
+
+	InternalStore *get_store(Symbol store_name) {
+		auto index = shape->slot_of(store_name);
+		if (index >= 0)
+			return slot(index);
 		else
 			return nullptr;
 	}
 
-	void add_default_stores(std::set<std::string> &stores) {
-		for (auto store : stores)
-			default_stores.insert(store);
-	}
+	InternalStore *&slot(uint32_t index) { return index < INLINE_SLOTS ? inline_slots[index] : overflow_slots[index - INLINE_SLOTS]; }
+	InternalStore *slot(uint32_t index) const { return index < INLINE_SLOTS ? inline_slots[index] : overflow_slots[index - INLINE_SLOTS]; }
+
+	void add_default_store(Symbol store);
 
-	bool is_default_store(std::string &store) { return default_stores.count(store) == 1; }
+	bool is_default_store(Symbol store) const { return shape->has_default_store(store); }
+	// objects become prototypes once something is cloned from them; mutating a prototype invalidates inline caches
+	bool is_prototype() const { return derived_shape != nullptr; }
+	// literals are shared by every load of the constant they were made from, so no stores can be added to them
+	void make_literal() { literal = true; }
+	bool is_literal() const { return literal; }
 
-	std::string get_type() const { return type; }
+	Symbol get_type() const { return type; }
 	uint32_t get_hash() const { return hash; }
-	Object *get_prototype() const { return prototype; }
+	Object *get_prototype() const { return shape->get_prototype(); }
+	Shape *get_shape() const { return shape; }
 
 	std::string to_string() const;
+
+	void visit_edges(Heap &heap) override;
 private:
+	friend class Shape;
+	friend class HeapImage;
+
+	static constexpr uint32_t INLINE_SLOTS = 2;
+
+	static void invalidate_inline_caches();
+
 	uint32_t hash;
-	Object *prototype;
-	std::string type;
-	std::map<std::string, InternalStore*> stores;
-	std::set<std::string> default_stores;
-};
\ No newline at end of file
+	Symbol type;
+	Shape *shape;
+	// root shape of objects cloned from this one
+	Shape *derived_shape = { nullptr };
+	bool literal = { false };
+	InternalStore *inline_slots[INLINE_SLOTS];
+	std::vector<InternalStore*> overflow_slots;
+};
+
+// Sends a message to an unboxed Int. Nothing is returned when the message needs a materialized Int object.
+std::optional<Value> send_unboxed_int(int32_t receiver, Symbol message, std::optional<std::variant<Register, Symbol, uint32_t>> stamp, Interpreter &interpreter);
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cstring>
+#include <fstream>
+
+// FIXME: only works on unix systems
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ObjectFile.h"
+#include "Error.h"
+
+using namespace ObjectFile;
+
+// FNV-1a
+uint32_t ObjectFile::checksum(uint8_t const *data, size_t size) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t ObjectFileWriter::symbol(Symbol symbol) {
+	auto index = symbol_indices.find(symbol);
+	if (index != symbol_indices.end())
+		return index->second;
+	auto const &name = symbol.str();
+	symbols.push_back({ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(name.size()) });
+	strings += name;
+	symbol_indices.emplace(symbol, symbols.size() - 1);
+	return symbols.size() - 1;
+}
+
+void ObjectFileWriter::begin_block(std::vector<uint32_t> const &block_scopes) {
+	blocks.push_back({ static_cast<uint32_t>(entered_scopes.size()), static_cast<uint32_t>(block_scopes.size()),
+			static_cast<uint32_t>(code.size()), 0 });
+	entered_scopes.insert(entered_scopes.end(), block_scopes.begin(), block_scopes.end());
+}
+
+void ObjectFileWriter::end_block() {
+	blocks.back().code_size = code.size() - blocks.back().code_offset;
+}
+
+void ObjectFileWriter::write(std::string const &filename) {
+	constexpr uint32_t num_sections = static_cast<uint32_t>(Section::Count);
+	SectionEntry table[num_sections];
+	void const *contents[num_sections];
+	auto add_section = [&table, &contents](Section section, auto const &records) {
+		auto i = static_cast<uint32_t>(section);
+		table[i] = { i, static_cast<uint32_t>(records.size()), 0, records.size() * sizeof(records[0]) };
+		contents[i] = records.data();
+	};
+	add_section(Section::Strings, strings);
+	add_section(Section::Symbols, symbols);
+	add_section(Section::Constants, constants);
+	add_section(Section::Scopes, scopes);
+	add_section(Section::Blocks, blocks);
+	add_section(Section::EnteredScopes, entered_scopes);
+	add_section(Section::Code, code);
+	add_section(Section::Uses, uses);
+	add_section(Section::Sources, sources);
+	add_section(Section::Objects, image.objects);
+	add_section(Section::Slots, image.slots);
+	add_section(Section::Stores, image.stores);
+	add_section(Section::Vecs, image.vecs);
+	add_section(Section::Elements, image.elements);
+	add_section(Section::Globals, image.globals);
+	add_section(Section::Registers, image.registers);
+	add_section(Section::ConstantValues, image.constants);
+
+	auto align = [](size_t offset) { return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT; };
+	size_t offset = align(sizeof(Header) + sizeof(table));
+	for (auto &entry : table) {
+		entry.offset = offset;
+		offset = align(offset + entry.size);
+	}
+
+	std::vector<uint8_t> file(offset, 0);
+	memcpy(file.data() + sizeof(Header), table, sizeof(table));
+	for (uint32_t i = 0; i < num_sections; i++) {
+		if (table[i].size)
+			memcpy(file.data() + table[i].offset, contents[i], table[i].size);
+	}
+
+	Header header;
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byte_order = BYTE_ORDER_MARK;
+	header.file_size = file.size();
+	header.checksum = checksum(file.data() + sizeof(Header), file.size() - sizeof(Header));
+	header.num_sections = num_sections;
+	memcpy(file.data(), &header, sizeof(Header));
+
+	std::ofstream outfile(filename, std::ios::binary);
+	outfile.write(reinterpret_cast<char*>(file.data()), file.size());
+	if (!outfile)
+		terminating_error(StampError::FileParsingError, "Could not write object-stamp file " + filename + ".");
+}
+
+ObjectFileReader::ObjectFileReader(std::string const &filename) : filename(filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0 || file_stat.st_size == 0) {
+		close(fd);
+		fail("it is empty or cannot be read");
+	}
+	size = file_stat.st_size;
+	auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+		fail("it cannot be mapped into memory");
+	data = { static_cast<uint8_t const*>(mapping), Unmap { size } };
+
+	if (size < sizeof(Header) || memcmp(data.get(), MAGIC, sizeof(MAGIC)) != 0)
+		fail("it is not an object-stamp file");
+	auto const &header = *reinterpret_cast<Header const*>(data.get());
+	if (header.byte_order != BYTE_ORDER_MARK)
+		fail("it was written on a machine with a different byte order");
+	if (header.version != VERSION)
+		fail("it was written for version " + std::to_string(header.version)
+			+ " of the format, expected version " + std::to_string(VERSION) + "; regenerate it");
+	if (header.file_size != size)
+		fail("it is truncated, expected " + std::to_string(header.file_size) + " bytes but found "
+			+ std::to_string(size));
+	if (header.checksum != checksum(data.get() + sizeof(Header), size - sizeof(Header)))
+		fail("its checksum does not match");
+	if (header.num_sections != static_cast<uint32_t>(Section::Count))
+		fail("it has an unexpected number of sections");
+
+	size_t record_sizes[] = {
+#define __OBJECT_FILE_SECTIONS(s, r) \
+		sizeof(r),
+		ENUMERATE_OBJECT_FILE_SECTIONS(__OBJECT_FILE_SECTIONS)
+#undef __OBJECT_FILE_SECTIONS
+	};
+	if (size < sizeof(Header) + sizeof(sections))
+		fail("its section table is truncated");
+	memcpy(sections, data.get() + sizeof(Header), sizeof(sections));
+	for (uint32_t i = 0; i < header.num_sections; i++) {
+		auto const &entry = sections[i];
+		if (entry.section != i || entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > size
+				|| entry.size > size - entry.offset || entry.size != entry.count * record_sizes[i])
+			fail("section " + std::to_string(i) + " is malformed");
+	}
+
+	auto strings = records<char>(Section::Strings);
+	auto symbol_records = records<SymbolRecord>(Section::Symbols);
+	symbols.reserve(count(Section::Symbols));
+	for (uint32_t i = 0; i < count(Section::Symbols); i++) {
+		auto const &record = symbol_records[i];
+		if (record.offset > count(Section::Strings) || record.size > count(Section::Strings) - record.offset)
+			fail("symbol " + std::to_string(i) + " is out of bounds");
+		symbols.push_back(Symbol::intern(std::string(strings + record.offset, record.size)));
+	}
+	for (uint32_t i = 0; i < get_num_constants(); i++) {
+		if (constant(i).type >= symbols.size() || constant(i).text >= symbols.size())
+			fail("constant " + std::to_string(i) + " is malformed");
+	}
+	for (uint32_t i = 0; i < get_num_blocks(); i++) {
+		auto const &record = block(i);
+		if (record.first_entered_scope > count(Section::EnteredScopes)
+				|| record.num_entered_scopes > count(Section::EnteredScopes) - record.first_entered_scope
+				|| record.code_offset > count(Section::Code) || record.code_size > count(Section::Code) - record.code_offset)
+			fail("block " + std::to_string(i) + " is out of bounds");
+	}
+	for (uint32_t i = 0; i < get_num_uses(); i++) {
+		if (use(i).name >= symbols.size() || use(i).block > get_num_blocks() || (i > 0 && use(i).block < use(i - 1).block))
+			fail("use " + std::to_string(i) + " is malformed");
+	}
+	if (count(Section::Sources) > 1 || (source() && source()->path >= symbols.size()))
+		fail("its source is malformed");
+}
+
+void ObjectFileReader::Unmap::operator()(uint8_t const *data) const {
+	munmap(const_cast<uint8_t*>(data), size);
+}
+
+void ObjectFileReader::begin_block(BlockRecord const &block) {
+	position = block.code_offset;
+	block_end = block.code_offset + block.code_size;
+	code = records<uint32_t>(Section::Code);
+}
+
+void ObjectFileReader::fail(std::string const &problem) const {
+	terminating_error(StampError::FileParsingError, "Cannot read " + filename + ": " + problem + ".");
+}
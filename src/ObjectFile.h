@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Symbol.h"
+
+// section, record type
+#define ENUMERATE_OBJECT_FILE_SECTIONS(S) \
+	S(Strings, char)                      \
+	S(Symbols, SymbolRecord)              \
+	S(Constants, ConstantRecord)          \
+	S(Scopes, ScopeRecord)                \
+	S(Blocks, BlockRecord)                \
+	S(EnteredScopes, uint32_t)            \
+	S(Code, uint32_t)                     \
+	S(Uses, UseRecord)                    \
+	S(Sources, SourceRecord)              \
+	S(Objects, ObjectRecord)              \
+	S(Slots, SlotRecord)                  \
+	S(Stores, StoreRecord)                \
+	S(Vecs, VecRecord)                    \
+	S(Elements, uint32_t)                 \
+	S(Globals, GlobalRecord)              \
+	S(Registers, ValueRecord)             \
+	S(ConstantValues, ConstantValueRecord)
+
+// Object-stamp files start with a header and a table of their sections. Every section starts at a multiple of
+// SECTION_ALIGNMENT and is an array of fixed size records, so a file is mapped into memory and its records are read
+// where they are instead of being parsed field by field. Names are indices into the symbol table, whose records point
+// into the bytes of the string section. Instructions are encoded in the code section as their type code followed by
+// operand words, and each block record points at the code of its instructions.
+//
+// Code:
+//   Load       dst, variable
+//   Send       dst, obj, message symbol, stamp kind, stamp
+//   Store      obj, store name symbol, store, is_mutable
+//   Jump       block
+//   JumpTrue   block, condition
+//   JumpFalse  block, condition
+//   Return     has_retval, retval
+//   Bind       src, variable
+//   Call       dst, function, is_tail_call, number of arguments, arguments...
+//   LoadConst  dst, constant
+// where a variable is its name symbol, is_local, depth and slot.
+//
+// A module compiled for use records the modules it uses, which are linked in front of the block they were used at,
+// and the source file it was compiled from.
+//
+// The remaining sections are an optional image of the heap after the code of the file was run: the objects, their
+// stores and Vecs, which are referred to by index, and the values of the globals, of the registers outside of functions
+// and of the constants. Prototypes come before the objects cloned from them.
+namespace ObjectFile {
+
+constexpr char MAGIC[8] = { 'O', 'S', 'T', 'A', 'M', 'P', '\r', '\n' };
+// bumped whenever the layout of a file or the encoding of an instruction changes
+constexpr uint32_t VERSION = 3;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t SECTION_ALIGNMENT = 16;
+// registers of a file past this are damage rather than code, so that relocating them cannot wrap around
+constexpr uint32_t MAX_REGISTERS = 1 << 24;
+
+enum class Section : uint32_t {
+#define __OBJECT_FILE_SECTIONS(s, r) \
+	s,
+	ENUMERATE_OBJECT_FILE_SECTIONS(__OBJECT_FILE_SECTIONS)
+#undef __OBJECT_FILE_SECTIONS
+	Count
+};
+
+struct Header {
+	char magic[8];
+	uint32_t version;
+	// BYTE_ORDER_MARK as written by the machine that wrote the file
+	uint32_t byte_order;
+	uint64_t file_size;
+	// of everything following the header
+	uint32_t checksum;
+	uint32_t num_sections;
+};
+
+struct SectionEntry {
+	uint32_t section;
+	uint32_t count;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct SymbolRecord {
+	uint32_t offset;
+	uint32_t size;
+};
+
+struct ConstantRecord {
+	uint32_t type;
+	uint32_t text;
+};
+
+struct ScopeRecord {
+	int32_t beginning;
+	int32_t end;
+	uint32_t flags;
+	uint32_t is_global;
+	uint32_t continue_dest;
+	uint32_t break_dest;
+	uint32_t num_params;
+	uint32_t num_slots;
+	int32_t enclosing_function;
+	uint32_t first_register;
+	uint32_t num_registers;
+};
+
+struct BlockRecord {
+	uint32_t first_entered_scope;
+	uint32_t num_entered_scopes;
+	// in words of the code section
+	uint32_t code_offset;
+	uint32_t code_size;
+};
+
+struct UseRecord {
+	uint32_t name;
+	uint32_t block;
+};
+
+// the compiled code is up to date while the source has the same size and either the same modification time or the
+// same checksum
+struct SourceRecord {
+	uint32_t path;
+	uint32_t checksum;
+	uint64_t size;
+	int64_t mtime;
+};
+
+struct ObjectRecord {
+	uint32_t type;
+	uint32_t hash;
+	// index of the prototype plus one, 0 if the object has none
+	uint32_t prototype;
+	uint32_t first_slot;
+	uint32_t num_slots;
+	// bit n is set if the default store with symbol id n is enabled
+	uint32_t default_stores_low;
+	uint32_t default_stores_high;
+};
+
+struct SlotRecord {
+	uint32_t name;
+	uint32_t store;
+};
+
+// value is an object or Vec index, a symbol for literals, the Int, the Char or the block of a function body
+struct StoreRecord {
+	uint32_t type;
+	uint32_t is_mutable;
+	uint32_t value;
+};
+
+struct VecRecord {
+	uint32_t first_element;
+	uint32_t num_elements;
+};
+
+struct GlobalRecord {
+	uint32_t name;
+	uint32_t object;
+};
+
+enum class ValueKind : uint32_t {
+	Empty,
+	Object,
+	String,
+	Int,
+	Vec,
+};
+
+// value is an object or Vec index, a symbol for strings or the Int
+struct ValueRecord {
+	uint32_t kind;
+	uint32_t value;
+};
+
+struct ConstantValueRecord {
+	uint32_t constant;
+	ValueRecord value;
+};
+
+// records of the heap image, see above
+struct Image {
+	std::vector<ObjectRecord> objects;
+	std::vector<SlotRecord> slots;
+	std::vector<StoreRecord> stores;
+	std::vector<VecRecord> vecs;
+	std::vector<uint32_t> elements;
+	std::vector<GlobalRecord> globals;
+	std::vector<ValueRecord> registers;
+	std::vector<ConstantValueRecord> constants;
+};
+
+uint32_t checksum(uint8_t const *data, size_t size);
+
+}
+
+// Collects the sections of an object-stamp file, which is written all at once.
+class ObjectFileWriter {
+public:
+	ObjectFileWriter() {}
+
+	uint32_t symbol(Symbol symbol);
+	void add_constant(Symbol type, Symbol text) { constants.push_back({ symbol(type), symbol(text) }); }
+	void add_scope(ObjectFile::ScopeRecord const &scope) { scopes.push_back(scope); }
+
+	// instructions written between begin_block and end_block are the instructions of the block
+	void begin_block(std::vector<uint32_t> const &entered_scopes);
+	void end_block();
+	void word(uint32_t word) { code.push_back(word); }
+
+	void add_use(Symbol name, uint32_t block) { uses.push_back({ symbol(name), block }); }
+	void set_source(Symbol path, uint32_t checksum, uint64_t size, int64_t mtime) {
+		sources = { { symbol(path), checksum, size, mtime } };
+	}
+
+	ObjectFile::Image &get_image() { return image; }
+
+	void write(std::string const &filename);
+private:
+	std::string strings;
+	std::vector<ObjectFile::SymbolRecord> symbols;
+	std::unordered_map<Symbol, uint32_t> symbol_indices;
+	std::vector<ObjectFile::ConstantRecord> constants;
+	std::vector<ObjectFile::ScopeRecord> scopes;
+	std::vector<ObjectFile::BlockRecord> blocks;
+	std::vector<uint32_t> entered_scopes;
+	std::vector<uint32_t> code;
+	std::vector<ObjectFile::UseRecord> uses;
+	std::vector<ObjectFile::SourceRecord> sources;
+	ObjectFile::Image image;
+};
+
+// Maps an object-stamp file into memory and checks that its header and sections are intact, failing with a
+// FileParsingError otherwise. The records of the file are only valid as long as the reader lives.
+class ObjectFileReader {
+public:
+	explicit ObjectFileReader(std::string const &filename);
+	ObjectFileReader(ObjectFileReader const &) = delete;
+	ObjectFileReader &operator=(ObjectFileReader const &) = delete;
+
+	// files that do not exist are not read
+	bool is_open() const { return data != nullptr; }
+
+	uint32_t get_num_constants() const { return count(ObjectFile::Section::Constants); }
+	ObjectFile::ConstantRecord const &constant(uint32_t index) const { return records<ObjectFile::ConstantRecord>(ObjectFile::Section::Constants)[index]; }
+	uint32_t get_num_scopes() const { return count(ObjectFile::Section::Scopes); }
+	ObjectFile::ScopeRecord const &scope(uint32_t index) const { return records<ObjectFile::ScopeRecord>(ObjectFile::Section::Scopes)[index]; }
+	uint32_t get_num_blocks() const { return count(ObjectFile::Section::Blocks); }
+	ObjectFile::BlockRecord const &block(uint32_t index) const { return records<ObjectFile::BlockRecord>(ObjectFile::Section::Blocks)[index]; }
+	uint32_t entered_scope(ObjectFile::BlockRecord const &block, uint32_t index) const {
+		return records<uint32_t>(ObjectFile::Section::EnteredScopes)[block.first_entered_scope + index];
+	}
+
+	uint32_t get_num_uses() const { return count(ObjectFile::Section::Uses); }
+	ObjectFile::UseRecord const &use(uint32_t index) const { return records<ObjectFile::UseRecord>(ObjectFile::Section::Uses)[index]; }
+	// source of a module compiled for use, nullptr for other files
+	ObjectFile::SourceRecord const *source() const {
+		return count(ObjectFile::Section::Sources) ? records<ObjectFile::SourceRecord>(ObjectFile::Section::Sources) : nullptr;
+	}
+
+	bool has_image() const { return count(ObjectFile::Section::Objects) > 0; }
+	// number and records of a section, whose indices have to be checked by the caller
+	uint32_t count(ObjectFile::Section section) const { return sections[static_cast<uint32_t>(section)].count; }
+	template<class T>
+	T const *records(ObjectFile::Section section) const {
+		return reinterpret_cast<T const*>(data.get() + sections[static_cast<uint32_t>(section)].offset);
+	}
+
+	// symbols are interned once when the file is opened
+	Symbol symbol(uint32_t index) const {
+		if (index >= symbols.size())
+			fail("symbol " + std::to_string(index) + " does not exist");
+		return symbols[index];
+	}
+
+	// reads the instructions of a block word by word
+	void begin_block(ObjectFile::BlockRecord const &block);
+	bool at_block_end() const { return position == block_end; }
+	uint32_t word() {
+		if (position == block_end)
+			fail("an instruction runs past the end of its basic block");
+		return code[position++];
+	}
+
+	void fail(std::string const &problem) const;
+private:
+
+	// unmaps the file, also when the constructor fails after mapping it
+	struct Unmap {
+		size_t size;
+		void operator()(uint8_t const *data) const;
+	};
+
+	std::string filename;
+	std::unique_ptr<uint8_t const, Unmap> data;
+	size_t size = { 0 };
+	ObjectFile::SectionEntry sections[static_cast<uint32_t>(ObjectFile::Section::Count)] = {};
+	std::vector<Symbol> symbols;
+
+	uint32_t const *code = { nullptr };
+	uint32_t position = { 0 };
+	uint32_t block_end = { 0 };
+};
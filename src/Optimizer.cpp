@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <unordered_set>
+
+#include "Optimizer.h"
+
+namespace {
+
+uint32_t jump_target(Instruction const *instruction) {
+	switch (instruction->get_type()) {
+		case Instruction::Type::Jump: return static_cast<Jump const*>(instruction)->get_jump();
+		case Instruction::Type::JumpTrue: return static_cast<JumpTrue const*>(instruction)->get_jump();
+		case Instruction::Type::JumpFalse: return static_cast<JumpFalse const*>(instruction)->get_jump();
+		default: return 0;
+	}
+}
+
+void set_jump_target(Instruction *instruction, uint32_t target) {
+	switch (instruction->get_type()) {
+		case Instruction::Type::Jump: static_cast<Jump*>(instruction)->set_jump(target); break;
+		case Instruction::Type::JumpTrue: static_cast<JumpTrue*>(instruction)->set_jump(target); break;
+		case Instruction::Type::JumpFalse: static_cast<JumpFalse*>(instruction)->set_jump(target); break;
+		default: break;
+	}
+}
+
+bool is_jump(Instruction const *instruction) {
+	auto type = instruction->get_type();
+	return type == Instruction::Type::Jump || type == Instruction::Type::JumpTrue || type == Instruction::Type::JumpFalse;
+}
+
+// execution never goes on to the next block after a jump or a return
+bool ends_block(Instruction const *instruction) {
+	auto type = instruction->get_type();
+	return type == Instruction::Type::Jump || type == Instruction::Type::Return;
+}
+
+bool loads_global(Instruction const *instruction, std::initializer_list<Symbol> names) {
+	if (instruction->get_type() != Instruction::Type::Load)
+		return false;
+	auto &variable = static_cast<Load const*>(instruction)->get_value();
+	if (variable.is_local)
+		return false;
+	for (auto name : names) {
+		if (variable.name == name)
+			return true;
+	}
+	return false;
+}
+
+// Int operation as the default stores of Int do it, nothing for operations that fail or overflow
+std::optional<std::variant<int32_t, bool>> fold(Symbol message, int32_t lhs, int32_t rhs) {
+	int64_t result;
+	switch (static_cast<WellKnownSymbol>(message.get_id())) {
+		case WellKnownSymbol::mod:
+		case WellKnownSymbol::div:
+			if (rhs == 0 || (lhs == INT32_MIN && rhs == -1))
+				return std::nullopt;
+			result = message == Symbols::mod ? lhs % rhs : lhs / rhs;
+			break;
+		case WellKnownSymbol::mul: result = (int64_t)lhs * rhs; break;
+		case WellKnownSymbol::add: result = (int64_t)lhs + rhs; break;
+		case WellKnownSymbol::sub: result = (int64_t)lhs - rhs; break;
+		case WellKnownSymbol::shl:
+			if (lhs < 0 || rhs < 0 || rhs > 31)
+				return std::nullopt;
+			result = (int64_t)lhs << rhs;
+			break;
+		case WellKnownSymbol::shr:
+			if (rhs < 0 || rhs > 31)
+				return std::nullopt;
+			result = lhs >> rhs;
+			break;
+		case WellKnownSymbol::and_: result = lhs & rhs; break;
+		case WellKnownSymbol::xor_: result = lhs ^ rhs; break;
+		case WellKnownSymbol::or_: result = lhs | rhs; break;
+		case WellKnownSymbol::lt: return lhs < rhs;
+		case WellKnownSymbol::le: return lhs <= rhs;
+		case WellKnownSymbol::gt: return lhs > rhs;
+		case WellKnownSymbol::ge: return lhs >= rhs;
+		case WellKnownSymbol::equals: return lhs == rhs;
+		case WellKnownSymbol::nequals: return lhs != rhs;
+		default: return std::nullopt;
+	}
+	if (result < INT32_MIN || result > INT32_MAX)
+		return std::nullopt;
+	return (int32_t)result;
+}
+
+}
+
+void Optimizer::run(uint32_t first_block) {
+	first = first_block;
+	end = generator.get_num_bbs();
+	if (level == 0 || first >= end)
+		return;
+
+	functions.assign(end - first, -1);
+	for (auto i = generator.first_scope_from(first); i < generator.get_num_scopes(); i++) {
+		auto scope = generator.get_scope(i);
+		if (!scope->can_return)
+			continue;
+		// scopes are numbered in the order they begin, so inner functions come after the functions around them
+		for (int32_t bb = scope->get_beginning(); bb <= scope->get_end() && bb < (int32_t)end; bb++)
+			functions[bb - first] = i;
+	}
+
+	if (dump) {
+		std::cout << "Before optimization: " << count_instructions() << " instructions\n";
+		dump_blocks();
+	}
+
+#define __OPTIMIZATION_PASSES(pass, name, min_level)                                               \
+	if (level >= min_level) {                                                                      \
+		auto before = count_instructions();                                                        \
+		pass();                                                                                    \
+		if (dump) {                                                                                \
+			std::cout << "After " << name << ": " << before << " -> " << count_instructions()      \
+					<< " instructions\n";                                                          \
+			dump_blocks();                                                                         \
+		}                                                                                          \
+	}
+
+	ENUMERATE_OPTIMIZATION_PASSES(__OPTIMIZATION_PASSES)
+
+#undef __OPTIMIZATION_PASSES
+}
+
+// Int operations on Int literals become literals of their results, comparisons become loads of True or False and
+// conditional jumps on True or False become unconditional or go away.
+void Optimizer::constant_folding() {
+	auto definitions = count_definitions();
+	std::unordered_map<uint32_t, int32_t> integers;
+	std::unordered_map<uint32_t, bool> booleans;
+
+	for (uint32_t bb = first; bb < end; bb++) {
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		for (size_t i = 0; i < instructions.size(); i++) {
+			auto instruction = instructions[i];
+			switch (instruction->get_type()) {
+				case Instruction::Type::LoadConst: {
+					auto load = static_cast<LoadConst*>(instruction);
+					auto &constant = generator.get_constant(load->get_index());
+					if (constant.type == Symbols::Int && definitions[load->get_dst().get_index()] == 1)
+						integers[load->get_dst().get_index()] = constant.integer;
+					break;
+				}
+				case Instruction::Type::Load: {
+					auto load = static_cast<Load*>(instruction);
+					if (loads_global(load, { Symbols::True, Symbols::False }) && definitions[load->get_dst().get_index()] == 1)
+						booleans[load->get_dst().get_index()] = load->get_value().name == Symbols::True;
+					break;
+				}
+				case Instruction::Type::Send: {
+					auto send = static_cast<Send*>(instruction);
+					auto &stamp = send->get_stamp();
+					if (!stamp || !std::holds_alternative<Register>(*stamp))
+						break;
+					auto lhs = integers.find(send->get_obj().get_index());
+					auto rhs = integers.find(std::get<Register>(*stamp).get_index());
+					if (lhs == integers.end() || rhs == integers.end())
+						break;
+					auto folded = fold(send->get_message(), lhs->second, rhs->second);
+					if (!folded)
+						break;
+
+					auto dst = send->get_dst();
+					if (auto integer = std::get_if<int32_t>(&*folded)) {
+						auto constant = generator.add_constant(Symbols::Int, Symbol::intern(std::to_string(*integer)));
+						instructions[i] = generator.make_instruction<LoadConst>(dst, constant);
+						integers[dst.get_index()] = *integer;
+					} else {
+						auto boolean = std::get<bool>(*folded);
+						instructions[i] = generator.make_instruction<Load>(dst, Variable(boolean ? Symbols::True : Symbols::False));
+						booleans[dst.get_index()] = boolean;
+					}
+					break;
+				}
+				case Instruction::Type::JumpTrue:
+				case Instruction::Type::JumpFalse: {
+					auto condition = instruction->get_type() == Instruction::Type::JumpTrue
+							? static_cast<JumpTrue*>(instruction)->get_condition()
+							: static_cast<JumpFalse*>(instruction)->get_condition();
+					auto boolean = booleans.find(condition.get_index());
+					if (boolean == booleans.end())
+						break;
+					if (boolean->second == (instruction->get_type() == Instruction::Type::JumpTrue)) {
+						instructions[i] = generator.make_instruction<Jump>(jump_target(instruction));
+					} else {
+						instructions.erase(instructions.begin() + i);
+						i--;
+					}
+					break;
+				}
+				default:
+					break;
+			}
+		}
+	}
+}
+
+// Literals are loaded once in the first block of their function, or of the code outside of functions, and each
+// constant is only loaded once there. Literals that are stored to keep their own load, since a store boxes an
+// unboxed Int in its register.
+void Optimizer::literal_hoisting() {
+	auto definitions = count_definitions();
+	std::unordered_set<uint32_t> stored_to;
+	// the first block of the code outside of functions may be run again when it is jumped back to
+	bool top_level_entry_is_target = false;
+	for (uint32_t bb = first; bb < end; bb++) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			if (instruction->get_type() == Instruction::Type::Store)
+				stored_to.insert(static_cast<Store*>(instruction)->get_obj().get_index());
+			if (is_jump(instruction) && jump_target(instruction) == first)
+				top_level_entry_is_target = true;
+		}
+	}
+
+	// registers of the loads by the entry they were moved to and their constant
+	std::map<std::pair<uint32_t, uint32_t>, Register> hoisted;
+	std::map<uint32_t, std::vector<Instruction*>> moved;
+	std::unordered_map<uint32_t, uint32_t> renamed;
+
+	for (uint32_t bb = first; bb < end; bb++) {
+		if (functions[bb - first] < 0 && top_level_entry_is_target)
+			continue;
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		for (size_t i = 0; i < instructions.size(); i++) {
+			if (instructions[i]->get_type() != Instruction::Type::LoadConst)
+				continue;
+			auto load = static_cast<LoadConst*>(instructions[i]);
+			auto dst = load->get_dst();
+			if (definitions[dst.get_index()] != 1 || stored_to.count(dst.get_index()))
+				continue;
+
+			auto entry = entry_of(bb);
+			auto key = std::make_pair(entry, load->get_index());
+			auto made = hoisted.find(key);
+			if (made != hoisted.end()) {
+				renamed[dst.get_index()] = made->second.get_index();
+			} else {
+				hoisted.emplace(key, dst);
+				moved[entry].push_back(load);
+			}
+			instructions.erase(instructions.begin() + i);
+			i--;
+		}
+	}
+
+	for (auto &[entry, loads] : moved) {
+		auto &instructions = generator.get_bbs()[entry]->get_instructions();
+		instructions.insert(instructions.begin(), loads.begin(), loads.end());
+	}
+	rename(renamed);
+}
+
+// A variable loaded again in the same block is taken from the register it was loaded or bound from, as long as
+// nothing could have bound it in between.
+void Optimizer::copy_propagation() {
+	auto definitions = count_definitions();
+	std::unordered_map<uint32_t, uint32_t> renamed;
+
+	for (uint32_t bb = first; bb < end; bb++) {
+		std::vector<std::pair<Variable, Register>> known;
+		auto find_known = [&known](Variable const &variable) {
+			for (auto it = known.begin(); it != known.end(); it++) {
+				if (it->first == variable)
+					return it;
+			}
+			return known.end();
+		};
+
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		for (size_t i = 0; i < instructions.size(); i++) {
+			auto instruction = instructions[i];
+			switch (instruction->get_type()) {
+				case Instruction::Type::Load: {
+					auto load = static_cast<Load*>(instruction);
+					auto dst = load->get_dst();
+					if (definitions[dst.get_index()] != 1)
+						break;
+					auto it = find_known(load->get_value());
+					if (it != known.end()) {
+						renamed[dst.get_index()] = it->second.get_index();
+						instructions.erase(instructions.begin() + i);
+						i--;
+					} else {
+						known.push_back({ load->get_value(), dst });
+					}
+					break;
+				}
+				case Instruction::Type::Bind: {
+					auto bind = static_cast<Bind*>(instruction);
+					auto it = find_known(bind->get_variable());
+					if (it != known.end())
+						known.erase(it);
+					if (definitions[bind->get_src().get_index()] == 1)
+						known.push_back({ bind->get_variable(), bind->get_src() });
+					break;
+				}
+				case Instruction::Type::Call:
+					// the function may bind globals and variables of the functions around it
+					known.clear();
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	// registers loaded again may have been replaced themselves
+	for (auto &[from, to] : renamed) {
+		auto it = renamed.find(to);
+		while (it != renamed.end()) {
+			to = it->second;
+			it = renamed.find(to);
+		}
+	}
+	rename(renamed);
+}
+
+// Jumps to empty blocks or to blocks that only jump go straight to where execution would continue, and jumps to the
+// block that follows anyway are removed.
+void Optimizer::jump_threading() {
+	auto destination = [this](uint32_t bb) {
+		// each block is passed at most once, so jumps around in a loop of empty blocks still end
+		for (uint32_t steps = 0; steps < end - first && bb >= first && bb < end && !enters_function(bb); steps++) {
+			auto &instructions = generator.get_bbs()[bb]->get_instructions();
+			if (instructions.empty())
+				bb++;
+			else if (instructions.size() == 1 && instructions[0]->get_type() == Instruction::Type::Jump)
+				bb = jump_target(instructions[0]);
+			else
+				break;
+		}
+		return bb;
+	};
+
+	for (uint32_t bb = first; bb < end; bb++) {
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		for (auto instruction : instructions) {
+			if (is_jump(instruction))
+				set_jump_target(instruction, destination(jump_target(instruction)));
+		}
+		if (!instructions.empty() && is_jump(instructions.back()) && jump_target(instructions.back()) == destination(bb + 1))
+			instructions.pop_back();
+	}
+}
+
+// Blocks that cannot be reached are emptied, and so is the rest of a block after a jump or a return. Loads of
+// literals and of prototypes that nothing uses are removed, except for the last register written outside of
+// functions, which holds the result that is shown.
+void Optimizer::dead_code_elimination() {
+	for (uint32_t bb = first; bb < end; bb++) {
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		auto last = std::find_if(instructions.begin(), instructions.end(), ends_block);
+		if (last != instructions.end())
+			instructions.erase(last + 1, instructions.end());
+	}
+
+	std::vector<bool> reachable(end - first, false);
+	std::vector<uint32_t> worklist = { first };
+	for (auto i = generator.first_scope_from(first); i < generator.get_num_scopes(); i++) {
+		auto scope = generator.get_scope(i);
+		if (scope->can_return)
+			worklist.push_back(scope->get_beginning());
+	}
+	while (!worklist.empty()) {
+		auto bb = worklist.back();
+		worklist.pop_back();
+		if (bb < first || bb >= end || reachable[bb - first])
+			continue;
+		reachable[bb - first] = true;
+
+		auto &instructions = generator.get_bbs()[bb]->get_instructions();
+		for (auto instruction : instructions) {
+			if (is_jump(instruction))
+				worklist.push_back(jump_target(instruction));
+		}
+		if (instructions.empty() || !ends_block(instructions.back()))
+			worklist.push_back(bb + 1);
+	}
+
+	std::optional<uint32_t> result;
+	for (uint32_t bb = first; bb < end; bb++) {
+		if (!reachable[bb - first]) {
+			generator.get_bbs()[bb]->get_instructions().clear();
+			continue;
+		}
+		if (functions[bb - first] >= 0)
+			continue;
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			if (auto dst = instruction->defined_register())
+				result = dst->get_index();
+		}
+	}
+
+	bool removed = true;
+	while (removed) {
+		removed = false;
+		auto uses = count_uses();
+		auto definitions = count_definitions();
+		for (uint32_t bb = first; bb < end; bb++) {
+			auto &instructions = generator.get_bbs()[bb]->get_instructions();
+			for (size_t i = 0; i < instructions.size(); i++) {
+				auto instruction = instructions[i];
+				auto dst = instruction->defined_register();
+				if (!dst || uses[dst->get_index()] > 0 || dst->get_index() == result || definitions[dst->get_index()] != 1)
+					continue;
+
+				if (instruction->get_type() == Instruction::Type::LoadConst
+						|| loads_global(instruction, { Symbols::Int, Symbols::Char, Symbols::String, Symbols::True, Symbols::False })) {
+					instructions.erase(instructions.begin() + i);
+					i--;
+					removed = true;
+				}
+			}
+		}
+	}
+}
+
+bool Optimizer::enters_function(uint32_t bb_index) const {
+	for (auto scope : generator.get_bbs()[bb_index]->get_entered_scopes()) {
+		if (generator.get_scope(scope)->can_return)
+			return true;
+	}
+	return false;
+}
+
+uint32_t Optimizer::entry_of(uint32_t bb_index) const {
+	auto function = functions[bb_index - first];
+	if (function < 0)
+		return first;
+	return generator.get_scope(function)->get_beginning();
+}
+
+std::unordered_map<uint32_t, uint32_t> Optimizer::count_uses() {
+	std::unordered_map<uint32_t, uint32_t> uses;
+	for (uint32_t bb = first; bb < end; bb++) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			for (auto reg : instruction->used_registers())
+				uses[reg->get_index()]++;
+		}
+	}
+	return uses;
+}
+
+std::unordered_map<uint32_t, uint32_t> Optimizer::count_definitions() {
+	std::unordered_map<uint32_t, uint32_t> definitions;
+	for (uint32_t bb = first; bb < end; bb++) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			if (auto dst = instruction->defined_register())
+				definitions[dst->get_index()]++;
+		}
+	}
+	return definitions;
+}
+
+void Optimizer::rename(std::unordered_map<uint32_t, uint32_t> const &renamed) {
+	if (renamed.empty())
+		return;
+	for (uint32_t bb = first; bb < end; bb++) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			for (auto reg : instruction->used_registers()) {
+				auto it = renamed.find(reg->get_index());
+				if (it != renamed.end())
+					*reg = Register(it->second);
+			}
+		}
+	}
+}
+
+size_t Optimizer::count_instructions() {
+	size_t count = 0;
+	for (uint32_t bb = first; bb < end; bb++)
+		count += generator.get_bbs()[bb]->get_instructions().size();
+	return count;
+}
+
+void Optimizer::dump_blocks() {
+	for (uint32_t bb = first; bb < end; bb++)
+		generator.get_bbs()[bb]->dump();
+}
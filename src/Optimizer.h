@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Generator.h"
+
+// pass, name, lowest optimization level that runs it
+#define ENUMERATE_OPTIMIZATION_PASSES(P)                      \
+	P(constant_folding, "constant folding", 2)                \
+	P(literal_hoisting, "literal hoisting", 1)                \
+	P(copy_propagation, "copy propagation", 1)                \
+	P(dead_code_elimination, "dead code elimination", 1)      \
+	P(jump_threading, "jump threading", 1)
+
+// Rewrites the basic blocks of newly generated code before it is assembled. Blocks are never removed or renumbered,
+// since scopes and function stamps refer to them by index, and every register is assumed to be written by a single
+// instruction, so the register allocator only runs afterwards. Level 1 only removes redundant work. Level 2 also
+// assumes that Int, True and False keep their default stores, which lets Int arithmetic on literals be done while
+// optimizing.
+class Optimizer {
+public:
+	static constexpr uint32_t MAX_LEVEL = 2;
+
+	Optimizer(Generator &generator, uint32_t level, bool dump) : generator(generator), level(level), dump(dump) {}
+
+	// optimizes the blocks from first_block to the last generated one
+	void run(uint32_t first_block);
+private:
+#define __OPTIMIZATION_PASSES(pass, name, min_level) \
+	void pass();
+	ENUMERATE_OPTIMIZATION_PASSES(__OPTIMIZATION_PASSES)
+#undef __OPTIMIZATION_PASSES
+
+	bool enters_function(uint32_t bb_index) const;
+	// block execution begins at for the code of the block, the first block for code outside of functions
+	uint32_t entry_of(uint32_t bb_index) const;
+	std::unordered_map<uint32_t, uint32_t> count_uses();
+	std::unordered_map<uint32_t, uint32_t> count_definitions();
+	void rename(std::unordered_map<uint32_t, uint32_t> const &renamed);
+	size_t count_instructions();
+	void dump_blocks();
+
+	Generator &generator;
+	uint32_t level;
+	bool dump;
+
+	// blocks being optimized
+	uint32_t first = { 0 };
+	uint32_t end = { 0 };
+	// scope of the innermost function containing each block being optimized, -1 outside of functions
+	std::vector<int32_t> functions;
+};
@@ -6,7 +6,70 @@
 
 #pragma once
 
+#include <string>
+
 #include "AST.h"
+#include "Lexer.h"
+#include "Token.h"
+
+// Parses one source into AST nodes of the generator's arena. The source has to live as long as the AST (see
+// Generator::add_source). A parser keeps all of its state, so sources with generators of their own can be parsed on
+// several threads at once.
+class Parser {
+public:
+	Parser(Source const &source, Generator *generator);
+
+	ASTNode *parse_program();
+
+	std::string error_msg(std::string error) const;
+private:
+	template<typename... Args>
+	ASTNode *make_node(Args&&... args);
+
+	void next_token();
+	void match(Token::TokenType expected);
+
+	void parse_statement_list(ASTNode *s);
+	ASTNode *parse_statement();
+	ASTNode *parse_statement_tail(ASTNode *object);
+	ASTNode *parse_message_tail(ASTNode *previous_message);
+	ASTNode *message_of(ASTNode *send);
+	ASTNode *parse_parameters(ASTNode *s);
+	ASTNode *parse_function_signature(ASTNode *s);
+	ASTNode *parse_param_type(ASTNode *param);
+	ASTNode *parse_next_param(ASTNode *so_far);
+	ASTNode *parse_function_tail(ASTNode *function);
+	ASTNode *parse_rhs(ASTNode *object);
+	ASTNode *parse_statement_rhs();
+	ASTNode *parse_if();
+	ASTNode *parse_if_tail();
+	ASTNode *parse_else_tail();
+	ASTNode *parse_while();
+	ASTNode *parse_vec(ASTNode *vec);
+	ASTNode *parse_use();
+	ASTNode *parse_return();
+
+	// Lists of statements, arguments, parameters and elements and chains of messages are parsed in loops, so long ones
+	// take no stack. What nests (blocks, vectors, arguments, stores and operators within each other) is parsed
+	// recursively, up to MAX_NESTING_DEPTH levels deep, so that sources fail to parse instead of overflowing the stack.
+	// Each of them is one level: an if, while or function is as deep as its body, and an else if is an if in the else.
+	static constexpr uint32_t MAX_NESTING_DEPTH = 1000;
+	struct Nesting {
+		explicit Nesting(Parser &parser) : parser(parser) {
+			if (parser.depth == MAX_NESTING_DEPTH)
+				throw parser.error_msg("Nesting is deeper than " + std::to_string(MAX_NESTING_DEPTH) + " levels.");
+			parser.depth++;
+		}
+		~Nesting() { parser.depth--; }
+
+		Parser &parser;
+	};
+
+	Source const &source;
+	Generator *generator;
+	Lexer lexer;
+	Token tok = { Token(Token::Program, &source, 0) };
+	uint32_t depth = { 0 };
+};
 
-ASTNode *parse(std::string&, std::vector<std::string>&, Generator *gen);
-std::string error_msg(std::string error);
\ No newline at end of file
+ASTNode *parse(Source const &source, Generator *gen);
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <set>
+#include <unordered_map>
+
+#include "RegisterAllocator.h"
+
+void RegisterAllocator::run(uint32_t first_block) {
+	auto end = generator.get_num_bbs();
+	if (first_block >= end)
+		return;
+
+	// scope of the innermost function containing each block, -1 outside of functions
+	std::vector<int32_t> functions(end - first_block, -1);
+	for (auto i = generator.first_scope_from(first_block); i < generator.get_num_scopes(); i++) {
+		auto scope = generator.get_scope(i);
+		if (!scope->can_return)
+			continue;
+		for (int32_t bb = scope->get_beginning(); bb <= scope->get_end() && bb < (int32_t)end; bb++)
+			functions[bb - first_block] = i;
+	}
+
+	std::unordered_map<int32_t, std::vector<uint32_t>> blocks;
+	for (uint32_t bb = first_block; bb < end; bb++)
+		blocks[functions[bb - first_block]].push_back(bb);
+	for (auto &[function, function_blocks] : blocks) {
+		if (function >= 0)
+			allocate_function(generator.get_scope(function), function_blocks);
+	}
+	if (blocks.count(-1))
+		number_outside_functions(blocks[-1]);
+}
+
+// Linear scan: intervals are visited in the order they begin and take the lowest register of the intervals that
+// ended before. A register is only reused after the instruction that reads it for the last time, so an instruction
+// never writes a register it also reads.
+void RegisterAllocator::allocate_function(LexicalScope *function, std::vector<uint32_t> const &blocks) {
+	auto intervals = live_intervals(blocks);
+	std::sort(intervals.begin(), intervals.end(), [](Interval const &a, Interval const &b) { return a.start < b.start; });
+
+	// end and register of the intervals being live, the one ending first on top
+	using Active = std::pair<uint32_t, uint32_t>;
+	std::priority_queue<Active, std::vector<Active>, std::greater<Active>> active;
+	std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> free;
+	uint32_t num_registers = 0;
+	std::unordered_map<uint32_t, uint32_t> allocated;
+
+	for (auto const &interval : intervals) {
+		while (!active.empty() && active.top().first < interval.start) {
+			free.push(active.top().second);
+			active.pop();
+		}
+		uint32_t reg;
+		if (free.empty()) {
+			reg = num_registers++;
+		} else {
+			reg = free.top();
+			free.pop();
+		}
+		active.push({ interval.end, reg });
+		allocated[interval.reg] = function->first_register + reg;
+	}
+
+	for (auto bb : blocks) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			auto registers = instruction->used_registers();
+			if (auto dst = instruction->destination())
+				registers.push_back(dst);
+			for (auto reg : registers)
+				*reg = Register(allocated[reg->get_index()]);
+		}
+	}
+	function->num_registers = num_registers;
+}
+
+// Positions number the instructions of the blocks in order, with empty blocks taking one position. A register is live
+// from its first definition or the first block it is live into, to its last use or the last block it is live out of.
+std::vector<RegisterAllocator::Interval> RegisterAllocator::live_intervals(std::vector<uint32_t> const &blocks) {
+	std::unordered_map<uint32_t, uint32_t> block_numbers;
+	for (uint32_t i = 0; i < blocks.size(); i++)
+		block_numbers[blocks[i]] = i;
+
+	std::vector<std::set<uint32_t>> uses(blocks.size()), definitions(blocks.size());
+	std::vector<std::vector<uint32_t>> successors(blocks.size());
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		auto &instructions = generator.get_bbs()[blocks[i]]->get_instructions();
+		bool falls_through = true;
+		for (auto instruction : instructions) {
+			for (auto reg : instruction->used_registers()) {
+				if (!definitions[i].count(reg->get_index()))
+					uses[i].insert(reg->get_index());
+			}
+			if (auto dst = instruction->destination())
+				definitions[i].insert(dst->get_index());
+
+			std::optional<uint32_t> target;
+			switch (instruction->get_type()) {
+				case Instruction::Type::Jump:
+					target = static_cast<Jump*>(instruction)->get_jump();
+					falls_through = false;
+					break;
+				case Instruction::Type::JumpTrue:
+					target = static_cast<JumpTrue*>(instruction)->get_jump();
+					break;
+				case Instruction::Type::JumpFalse:
+					target = static_cast<JumpFalse*>(instruction)->get_jump();
+					break;
+				case Instruction::Type::Return:
+					falls_through = false;
+					break;
+				default:
+					break;
+			}
+			if (target && block_numbers.count(*target))
+				successors[i].push_back(block_numbers[*target]);
+		}
+		// blocks of the function follow each other, except around functions declared in it, which are jumped over
+		if (falls_through && block_numbers.count(blocks[i] + 1))
+			successors[i].push_back(block_numbers[blocks[i] + 1]);
+	}
+
+	std::vector<std::set<uint32_t>> live_in(blocks.size()), live_out(blocks.size());
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (auto i = blocks.size(); i-- > 0;) {
+			std::set<uint32_t> out;
+			for (auto successor : successors[i])
+				out.insert(live_in[successor].begin(), live_in[successor].end());
+			auto in = uses[i];
+			for (auto reg : out) {
+				if (!definitions[i].count(reg))
+					in.insert(reg);
+			}
+			if (in != live_in[i] || out != live_out[i]) {
+				live_in[i] = std::move(in);
+				live_out[i] = std::move(out);
+				changed = true;
+			}
+		}
+	}
+
+	std::unordered_map<uint32_t, Interval> intervals;
+	auto extend = [&intervals](uint32_t reg, uint32_t position) {
+		auto it = intervals.find(reg);
+		if (it == intervals.end()) {
+			intervals.emplace(reg, Interval { reg, position, position });
+		} else {
+			it->second.start = std::min(it->second.start, position);
+			it->second.end = std::max(it->second.end, position);
+		}
+	};
+	uint32_t position = 0;
+	for (uint32_t i = 0; i < blocks.size(); i++) {
+		auto &instructions = generator.get_bbs()[blocks[i]]->get_instructions();
+		auto first = position;
+		for (auto instruction : instructions) {
+			for (auto reg : instruction->used_registers())
+				extend(reg->get_index(), position);
+			if (auto dst = instruction->destination())
+				extend(dst->get_index(), position);
+			position++;
+		}
+		if (instructions.empty())
+			position++;
+		for (auto reg : live_in[i])
+			extend(reg, first);
+		for (auto reg : live_out[i])
+			extend(reg, position - 1);
+	}
+
+	std::vector<Interval> result;
+	for (auto &[reg, interval] : intervals)
+		result.push_back(interval);
+	return result;
+}
+
+void RegisterAllocator::number_outside_functions(std::vector<uint32_t> const &blocks) {
+	std::set<uint32_t> registers;
+	for (auto bb : blocks) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			for (auto reg : instruction->used_registers())
+				registers.insert(reg->get_index());
+			if (auto dst = instruction->destination())
+				registers.insert(dst->get_index());
+		}
+	}
+	if (registers.empty())
+		return;
+
+	// registers of earlier code are below the registers of this code
+	auto first = *registers.begin();
+	std::unordered_map<uint32_t, uint32_t> numbered;
+	for (auto reg : registers)
+		numbered[reg] = first + numbered.size();
+	for (auto bb : blocks) {
+		for (auto instruction : generator.get_bbs()[bb]->get_instructions()) {
+			auto used = instruction->used_registers();
+			if (auto dst = instruction->destination())
+				used.push_back(dst);
+			for (auto reg : used)
+				*reg = Register(numbered[reg->get_index()]);
+		}
+	}
+	generator.release_registers(first + registers.size());
+}
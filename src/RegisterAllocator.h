@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Generator.h"
+
+// Renumbers the registers of newly generated code once it has been optimized. The generator hands out a new register
+// for every temporary, so a function would need as many registers as it has temporaries. Registers of a function are
+// given the lowest register that is not live while they are, so its frame only holds as many registers as are live at
+// once. Registers outside of functions are only numbered without gaps, since they keep their values after a run and
+// are shown, with the last one holding the result.
+class RegisterAllocator {
+public:
+	RegisterAllocator(Generator &generator) : generator(generator) {}
+
+	// allocates the registers of the blocks from first_block to the last generated one
+	void run(uint32_t first_block);
+private:
+	// a register and the positions of the first and last instructions it is live at
+	struct Interval {
+		uint32_t reg;
+		uint32_t start;
+		uint32_t end;
+	};
+
+	void allocate_function(LexicalScope *function, std::vector<uint32_t> const &blocks);
+	void number_outside_functions(std::vector<uint32_t> const &blocks);
+	std::vector<Interval> live_intervals(std::vector<uint32_t> const &blocks);
+
+	Generator &generator;
+};
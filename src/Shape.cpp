@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Shape.h"
+#include "Object.h"
+
+Shape *Shape::root_for(Object *prototype) {
+	if (!prototype) {
+		static Shape *root = new Shape(nullptr, {}, 0);
+		return root;
+	}
+	if (!prototype->derived_shape)
+		prototype->derived_shape = new Shape(prototype, {}, 0);
+	return prototype->derived_shape;
+}
+
+Shape *Shape::with_store(Symbol store) {
+	auto transition = store_transitions.find(store);
+	if (transition != store_transitions.end())
+		return transition->second;
+
+	auto names = slot_names;
+	names.push_back(store);
+	auto shape = new Shape(prototype, names, default_stores);
+	store_transitions[store] = shape;
+	return shape;
+}
+
+Shape *Shape::with_default_store(Symbol store) {
+	if (has_default_store(store))
+		return this;
+
+	auto transition = default_store_transitions.find(store);
+	if (transition != default_store_transitions.end())
+		return transition->second;
+
+	auto shape = new Shape(prototype, slot_names, default_stores | (1ull << store.get_id()));
+	default_store_transitions[store] = shape;
+	return shape;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Symbol.h"
+
+class Object;
+
+// Describes the layout of an object: its prototype, which store lives in which slot and which default stores are
+// enabled. Objects with the same prototype that gained the same stores in the same order share a shape, and adding a
+// store moves an object along a cached transition to the next shape.
+class Shape {
+public:
+	static Shape *root_for(Object *prototype);
+
+	~Shape() {
+		for (auto &transition : store_transitions)
+			delete transition.second;
+		for (auto &transition : default_store_transitions)
+			delete transition.second;
+	}
+
+	Shape *with_store(Symbol store);
+	Shape *with_default_store(Symbol store);
+
+	int32_t slot_of(Symbol store) const {
+		for (uint32_t i = 0; i < slot_names.size(); i++) {
+			if (slot_names[i] == store)
+				return i;
+		}
+		return -1;
+	}
+	bool has_default_store(Symbol store) const { return store.get_id() < 64 && (default_stores & (1ull << store.get_id())); }
+
+	Object *get_prototype() const { return prototype; }
+	uint32_t get_num_slots() const { return slot_names.size(); }
+	Symbol get_slot_name(uint32_t slot) const { return slot_names[slot]; }
+	uint64_t get_default_stores() const { return default_stores; }
+private:
+	Shape(Object *prototype, std::vector<Symbol> slot_names, uint64_t default_stores)
+			: prototype(prototype), slot_names(slot_names), default_stores(default_stores) {}
+
+	Object *prototype;
+	std::vector<Symbol> slot_names;
+	// bit n is set if the default store with symbol id n is enabled
+	uint64_t default_stores;
+
+	std::unordered_map<Symbol, Shape*> store_transitions;
+	std::unordered_map<Symbol, Shape*> default_store_transitions;
+};
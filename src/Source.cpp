@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+
+// FIXME: only works on unix systems
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Source.h"
+#include "Error.h"
+
+Source::~Source() {
+	if (mapping)
+		munmap(mapping, mapping_size);
+}
+
+std::unique_ptr<Source> Source::from_file(std::string const &name, std::string const &path) {
+	std::unique_ptr<Source> source(new Source(name));
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		terminating_error(StampError::FileParsingError, "Cannot open " + path + ".");
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0) {
+		close(fd);
+		terminating_error(StampError::FileParsingError, "Cannot read " + path + ".");
+	}
+
+	if (S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+		auto mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			close(fd);
+			source->mapping = mapping;
+			source->mapping_size = file_stat.st_size;
+			source->text = std::string_view(static_cast<char const*>(mapping), file_stat.st_size);
+			return source;
+		}
+	}
+
+	// pipes and other files that cannot be mapped are read
+	char buffer[65536];
+	ssize_t num_read;
+	while ((num_read = read(fd, buffer, sizeof(buffer))) > 0)
+		source->owned.append(buffer, num_read);
+	close(fd);
+	if (num_read < 0)
+		terminating_error(StampError::FileParsingError, "Cannot read " + path + ".");
+	source->text = source->owned;
+	return source;
+}
+
+std::pair<uint32_t, uint32_t> Source::line_and_column(uint32_t offset) const {
+	if (line_starts.empty()) {
+		line_starts.push_back(0);
+		for (uint32_t i = 0; i < text.size(); i++) {
+			if (text[i] == '\n')
+				line_starts.push_back(i + 1);
+		}
+	}
+	auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin() - 1;
+	return { line, offset - line_starts[line] };
+}
+
+std::string Source::position(uint32_t offset) const {
+	auto [line, column] = line_and_column(offset);
+	if (name.str() != "")
+		return name.str() + ":" + std::to_string(line) + ":" + std::to_string(column);
+	return std::to_string(line) + ":" + std::to_string(column);
+}
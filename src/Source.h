@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Symbol.h"
+
+// The text of a source file in one contiguous buffer, which files are mapped into rather than read into. Tokens refer
+// to their place in it by offset; lines are only needed for error messages, so they are found on the first of them.
+class Source {
+public:
+	Source(std::string const &name, std::string text) : name(Symbol::intern(name)), owned(std::move(text)), text(owned) {}
+	~Source();
+
+	Source(Source const &) = delete;
+	Source &operator=(Source const &) = delete;
+
+	// the file at path, named name in error messages
+	static std::unique_ptr<Source> from_file(std::string const &name, std::string const &path);
+
+	Symbol get_name() const { return name; }
+	std::string_view get_text() const { return text; }
+
+	// line and column of an offset, both counted from 0
+	std::pair<uint32_t, uint32_t> line_and_column(uint32_t offset) const;
+	// name:line:column of an offset, or line:column for unnamed sources
+	std::string position(uint32_t offset) const;
+private:
+	explicit Source(std::string const &name) : name(Symbol::intern(name)) {}
+
+	Symbol name;
+	std::string owned;
+	void *mapping = { nullptr };
+	size_t mapping_size = { 0 };
+	std::string_view text;
+	// offsets at which lines start, found on the first request
+	mutable std::vector<uint32_t> line_starts;
+};
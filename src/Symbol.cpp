@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "Symbol.h"
+#include "Error.h"
+
+class SymbolTable {
+public:
+	SymbolTable() {
+#define __WELL_KNOWN_SYMBOLS(n, s) \
+		intern(s);
+		ENUMERATE_WELL_KNOWN_SYMBOLS(__WELL_KNOWN_SYMBOLS)
+#undef __WELL_KNOWN_SYMBOLS
+	}
+
+	uint32_t intern(std::string_view name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = ids.find(name);
+		if (it != ids.end())
+			return it->second;
+		uint32_t id = num_names;
+		if (id / CHUNK_SIZE >= MAX_CHUNKS)
+			terminating_error(StampError::BytecodeGenerationError, "Too many symbols.");
+		auto &chunk = chunks[id / CHUNK_SIZE];
+		if (!chunk)
+			chunk = std::make_unique<std::string[]>(CHUNK_SIZE);
+		chunk[id % CHUNK_SIZE] = std::string(name);
+		ids.emplace(chunk[id % CHUNK_SIZE], id);
+		num_names++;
+		return id;
+	}
+
+	std::string const &name(uint32_t id) const { return chunks[id / CHUNK_SIZE][id % CHUNK_SIZE]; }
+
+	static SymbolTable &the() {
+		static SymbolTable table;
+		return table;
+	}
+private:
+	// Names are kept in chunks that never move, so the views used as keys stay valid and names are read without
+	// taking the lock: a thread only has a symbol once it was interned. Modules are compiled on several threads.
+	static constexpr uint32_t CHUNK_SIZE = 4096;
+	static constexpr uint32_t MAX_CHUNKS = 4096;
+	std::unique_ptr<std::string[]> chunks[MAX_CHUNKS];
+	uint32_t num_names = { 0 };
+	std::unordered_map<std::string_view, uint32_t> ids;
+	std::mutex mutex;
+};
+
+Symbol Symbol::intern(std::string_view name) {
+	return Symbol(SymbolTable::the().intern(name));
+}
+
+std::string const &Symbol::str() const {
+	return SymbolTable::the().name(id);
+}
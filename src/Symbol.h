@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <functional>
+
+// Default stores come first so that their ids fit into Object's default store bitmask.
+#define ENUMERATE_WELL_KNOWN_SYMBOLS(S)           \
+	S(clone, "clone")                             \
+	S(equals, "==")                               \
+	S(nequals, "!=")                              \
+	S(store_value, "store_value")                 \
+	S(get, "get")                                 \
+	S(push, "push")                               \
+	S(clone_callable, "clone_callable")           \
+	S(store_param, "store_param")                 \
+	S(pass_body, "pass_body")                     \
+	S(mod, "%")                                   \
+	S(mul, "*")                                   \
+	S(div, "/")                                   \
+	S(add, "+")                                   \
+	S(sub, "-")                                   \
+	S(shl, "<<")                                  \
+	S(shr, ">>")                                  \
+	S(lt, "<")                                    \
+	S(le, "<=")                                   \
+	S(gt, ">")                                    \
+	S(ge, ">=")                                   \
+	S(and_, "&")                                  \
+	S(xor_, "><")                                 \
+	S(or_, "|")                                   \
+	S(value, "value")                             \
+	S(type, "type")                               \
+	S(body, "body")                               \
+	S(param_names, "param_names")                 \
+	S(default_, "default")                        \
+	S(Object, "Object")                           \
+	S(True, "True")                               \
+	S(False, "False")                             \
+	S(Int, "Int")                                 \
+	S(Char, "Char")                               \
+	S(String, "String")                           \
+	S(Vec, "Vec")                                 \
+	S(Callable, "Callable")
+
+enum class WellKnownSymbol : uint32_t {
+#define __WELL_KNOWN_SYMBOLS(n, s) \
+	n,
+	ENUMERATE_WELL_KNOWN_SYMBOLS(__WELL_KNOWN_SYMBOLS)
+#undef __WELL_KNOWN_SYMBOLS
+	Count
+};
+
+// An interned name. Symbols are resolved once (at bytecode generation or when reading an object-stamp file),
+// after which comparing and hashing them is an integer operation.
+class Symbol {
+public:
+	constexpr explicit Symbol(uint32_t id) : id(id) {}
+
+	static Symbol intern(std::string_view name);
+
+	std::string const &str() const;
+	uint32_t get_id() const { return id; }
+	// names starting with :: are generated by the compiler and default stores and never name an object in a context
+	bool is_internal() const { return str().compare(0, 2, "::") == 0; }
+
+	bool operator==(Symbol const &other) const { return id == other.id; }
+	bool operator!=(Symbol const &other) const { return id != other.id; }
+	bool operator<(Symbol const &other) const { return id < other.id; }
+private:
+	uint32_t id;
+};
+
+namespace Symbols {
+#define __WELL_KNOWN_SYMBOLS(n, s) \
+	constexpr Symbol n = Symbol(static_cast<uint32_t>(WellKnownSymbol::n));
+	ENUMERATE_WELL_KNOWN_SYMBOLS(__WELL_KNOWN_SYMBOLS)
+#undef __WELL_KNOWN_SYMBOLS
+}
+
+template<>
+struct std::hash<Symbol> {
+	size_t operator()(Symbol const &symbol) const noexcept { return symbol.get_id(); }
+};
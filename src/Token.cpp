@@ -16,7 +16,7 @@ std::string Token::token_str() const {
 		ENUMERATE_TOKENS(__TOK_STR)
 #undef __TOK_STR
 	}
-	return s + "(" + value + ")";
+	return s + "(" + std::string(value) + ")";
 }
 
 std::string Token::token_readable() const {
@@ -27,7 +27,7 @@ std::string Token::token_readable() const {
 		case Char:
 		case String:
 		case List:
-		case Value: return value;
+		case Value: return std::string(value);
 		case Send: return "Send";
 		case Store: return "=";
 		case Eof: return "EOF";
@@ -60,7 +60,5 @@ std::string Token::token_readable() const {
 }
 
 std::string Token::position() const {
-	if (file != "")
-		return file + ":" + std::to_string(line) + ":" + std::to_string(column);
-	return std::to_string(line) + ":" + std::to_string(column);
-}
\ No newline at end of file
+	return source->position(offset);
+}
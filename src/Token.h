@@ -6,7 +6,11 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+
+#include "Source.h"
 
 #define ENUMERATE_TOKENS(T) \
 	T(Object) \
@@ -54,18 +58,19 @@ public:
 #undef __DEFINE_TOKEN_TYPES
 	};
 
-	Token(TokenType type, std::string value, std::string file, size_t line, size_t column)
-		: type(type), value(value), file(file), line(line), column(column) {}
-	Token(TokenType type, std::string file, size_t line, size_t column)
-		: type(type), file(file), line(line), column(column) {}
+	Token(TokenType type, std::string_view value, Source const *source, uint32_t offset)
+		: type(type), value(value), source(source), offset(offset) {}
+	Token(TokenType type, Source const *source, uint32_t offset)
+		: type(type), source(source), offset(offset) {}
 
 	std::string token_str() const;
 	std::string token_readable() const;
 	std::string position() const;
 
 	TokenType type;
-	std::string value;
-	std::string file;
-	size_t line;
-	size_t column;
+	// a view into the source or into the AST arena (see Lexer), valid for as long as the AST is
+	std::string_view value;
+	// where in its source the token is, which lives as long as the AST does (see Generator::add_source)
+	Source const *source;
+	uint32_t offset;
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <exception>
+
+#include "VM.h"
+#include "Parser.h"
+#include "Generator.h"
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include "RegisterAllocator.h"
+
+VM::VM(VMOptions options) : options(std::move(options)) {
+	reset();
+}
+
+VM::~VM() = default;
+
+void VM::reset() {
+	auto prelude = std::make_unique<Generator>(options.dirs);
+	prelude->read_from_file(options.prelude);
+	// stamp goes on without a prelude, which is how the prelude is made, but a VM cannot run anything without one
+	if (prelude->get_num_bbs() == 0)
+		terminating_error(StampError::FileParsingError, "Cannot read prelude " + options.prelude + ".");
+
+	// the interpreter refers to the generator and its roots keep the objects alive until it is gone
+	interpreter.reset();
+	generator = std::move(prelude);
+	interpreter = std::make_unique<Interpreter>(*generator);
+	interpreter->set_max_call_depth(options.max_call_depth);
+	// runs the prelude unless its heap image was adopted
+	interpreter->run();
+}
+
+VMResult VM::run_file(std::string filename) {
+	return run([this, &filename] { return generator->include_from(filename); });
+}
+
+VMResult VM::run_source(std::string const &source, std::string name) {
+	return run([this, &source, &name] {
+		return parse(generator->add_source(std::make_unique<Source>(name, source)), generator.get());
+	});
+}
+
+VMResult VM::run(std::function<ASTNode*()> const &parse_code) {
+	auto checkpoint = generator->checkpoint();
+	try {
+		if (auto ast = parse_code())
+			ast->generate_bytecode(*generator);
+		generator->release_ast();
+		Optimizer(*generator, options.optimization_level, false).run(checkpoint.num_basic_blocks);
+		RegisterAllocator(*generator).run(checkpoint.num_basic_blocks);
+	} catch (StampException const &error) {
+		generator->rollback(checkpoint);
+		return { std::nullopt, error };
+	}
+
+	VMResult result;
+	try {
+		interpreter->run();
+		result.value = interpreter->last_value(checkpoint.register_number);
+	} catch (StampException const &error) {
+		interpreter->abandon();
+		result.error = error;
+	} catch (std::exception const &error) {
+		// default stores are plain C++ and whatever they throw is an error of the script that sent them
+		interpreter->abandon();
+		result.error = StampException { StampError::ExecutionError, error.what() };
+	}
+	// the code outside of functions never runs again, so its registers are handed out to the next code
+	interpreter->clear_registers(checkpoint.register_number);
+	generator->release_registers(checkpoint.register_number);
+	return result;
+}
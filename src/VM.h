@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CallStack.h"
+#include "Error.h"
+
+class ASTNode;
+class Generator;
+class Interpreter;
+
+struct VMOptions {
+	std::string prelude = { "prelude.ostamp" };
+	// searched by use
+	std::vector<std::string> dirs = { "." };
+	uint32_t max_call_depth = { CallStack::DEFAULT_MAX_DEPTH };
+	uint32_t optimization_level = { 0 };
+};
+
+struct VMResult {
+	// value of the last expression outside of functions, as printed by stamp -r, if the code has one
+	std::optional<std::string> value;
+	std::optional<StampException> error;
+
+	bool ok() const { return !error; }
+};
+
+// Interpreter for embedding stamp: the prelude is loaded once and every script or snippet run afterwards sees the
+// globals of the ones before it. Errors are returned instead of exiting. Code that fails to compile leaves nothing
+// behind, code that fails while running keeps what it did until then. The code of everything run is kept until the
+// VM is reset, which frees it and the objects made since the prelude.
+//
+// All VMs of a process share one heap and symbol table, so they have to be used from the same thread. Making a VM
+// fails with a StampException when its prelude cannot be loaded.
+class VM {
+public:
+	explicit VM(VMOptions options = {});
+	VM(VM const &) = delete;
+	VM &operator=(VM const &) = delete;
+	~VM();
+
+	VMResult run_file(std::string filename);
+	// name is used in error messages
+	VMResult run_source(std::string const &source, std::string name = "");
+
+	// back to right after the prelude was loaded, or, when the prelude cannot be loaded anymore, a StampException and
+	// the VM as it was
+	void reset();
+
+	Generator &get_generator() { return *generator; }
+	Interpreter &get_interpreter() { return *interpreter; }
+private:
+	VMResult run(std::function<ASTNode*()> const &parse_code);
+
+	VMOptions options;
+	std::unique_ptr<Generator> generator;
+	std::unique_ptr<Interpreter> interpreter;
+};
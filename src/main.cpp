@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <exception>
 #include <iostream>
 #include <optional>
 #include <vector>
@@ -13,42 +14,56 @@
 #include "Parser.h"
 #include "Generator.h"
 #include "Interpreter.h"
+#include "Optimizer.h"
+#include "RegisterAllocator.h"
 
 bool dump_ast = false;
 bool dump_bytecode = false;
 bool dump_all_registers = false;
+bool dump_statistics = false;
 bool generate_bytecode_file = false;
+bool write_heap_image = false;
 std::optional<std::string> bytecode_file = std::nullopt;
 bool interpret_from_bytecode_file = false;
 std::vector<std::string> dirs{"."};
+uint32_t max_call_depth = CallStack::DEFAULT_MAX_DEPTH;
+uint32_t optimization_level = 0;
 
 void interpret_cmdline() {
 	Generator generator(dirs);
 	std::string prelude = "prelude.ostamp";
 	generator.read_from_file(prelude);
+	// the prelude's registers are only printed with -r
+	auto first_register = dump_all_registers ? 0 : generator.get_num_registers();
 
 	Interpreter interpreter(generator);
+	interpreter.set_max_call_depth(max_call_depth);
+	Optimizer optimizer(generator, optimization_level, dump_bytecode);
 
 	while (1) {
 		std::cout << "> ";
 		std::string line;
 		getline(std::cin, line);
-		std::vector<std::string> program;
-		program.push_back(line);
-		std::string filename;
 
-		auto ast = parse(filename, program, &generator);
-		if (!ast)
+		auto first_block = generator.get_num_bbs();
+		auto ast = parse(generator.add_source(std::make_unique<Source>("", line)), &generator);
+		if (!ast) {
+			generator.release_ast();
 			continue;
+		}
 
 		if (dump_ast)
 			std::cout << ast->to_string() << "\n";
 
 		ast->generate_bytecode(generator);
+		generator.release_ast();
+		optimizer.run(first_block);
+		RegisterAllocator(generator).run(first_block);
 
 		if (dump_bytecode)  {
 			generator.dump_basic_blocks();
 			generator.dump_scopes();
+			generator.dump_constants();
 		}
 
 		if (generate_bytecode_file)
@@ -56,7 +71,9 @@ void interpret_cmdline() {
 
 		interpreter.run();
 		std::cout << "\n";
-		interpreter.dump();
+		interpreter.dump(first_register);
+		if (dump_statistics)
+			interpreter.dump_statistics();
 	}
 }
 
@@ -64,10 +81,13 @@ void interpret_file(std::string &filename) {
 	Generator generator(dirs);
 	std::string prelude = "prelude.ostamp";
 	generator.read_from_file(prelude);
+	// the prelude's registers are only printed with -r
+	auto first_register = dump_all_registers ? 0 : generator.get_num_registers();
 
 	if (interpret_from_bytecode_file)
 		generator.read_from_file(filename);
 	else {
+		auto first_block = generator.get_num_bbs();
 		auto ast = generator.include_from(filename);
 		if (!ast)
 			return;
@@ -76,32 +96,49 @@ void interpret_file(std::string &filename) {
 			std::cout << ast->to_string() << "\n";
 
 		ast->generate_bytecode(generator);
+		generator.release_ast();
+		Optimizer(generator, optimization_level, dump_bytecode).run(first_block);
+		RegisterAllocator(generator).run(first_block);
 	}
 
 	if (dump_bytecode)  {
 		generator.dump_basic_blocks();
 		generator.dump_scopes();
+		generator.dump_constants();
 	}
 
-	if (generate_bytecode_file)
+	if (generate_bytecode_file && !write_heap_image)
 		generator.write_to_file(*bytecode_file);
 
 	Interpreter interpreter(generator);
+	interpreter.set_max_call_depth(max_call_depth);
 	interpreter.run();
+	if (generate_bytecode_file && write_heap_image)
+		generator.write_to_file(*bytecode_file, &interpreter);
 	std::cout << "\n";
-	interpreter.dump();
+	interpreter.dump(first_register);
+	if (dump_statistics)
+		interpreter.dump_statistics();
 }
 
 void help_message() {
-	printf("Usage: stamp [-h] [-a] [-b] [-r] [-o [bytecode_file]] [-f bytecode_input] [-d dirs] [input_file]\n\n");
+	printf("Usage: stamp [-h] [-a] [-b] [-r] [-s] [-o [bytecode_file]] [-i] [-f bytecode_input] [-d dirs] [-c max_call_depth] [-O[level]] [input_file]\n\n");
 	printf("Arguments:\n");
 	printf("-h                  Print this help message and exit.\n");
 	printf("-a                  Print the output abstract syntax tree.\n");
 	printf("-b                  Print the generated bytecode.\n");
-	printf("-r                  Print all register values after an interpreter run.\n");
+	printf("-r                  Print all register values after an interpreter run, including the prelude's. Without it only the\n");
+	printf("                    registers of the input are printed.\n");
+	printf("-s                  Print interpreter statistics after a run.\n");
 	printf("-o [bytecode_file]  Output generated bytecode to bytecode_file. If no bytecode_file is given, the name of the file will be parsed from input_file.\n");
+	printf("-i                  With -o, write bytecode_file after running input_file, with an image of the heap. Runs reading\n");
+	printf("                    bytecode_file first, like the prelude, start from the image instead of running the code again.\n");
 	printf("-f bytecode_input   Take input from a bytecode file bytecode_input.\n");
 	printf("-d dirs             Specifies which directories to search for use keyword. dirs is a comma-separated list of directories.\n");
+	printf("-c max_call_depth   Maximum depth of nested function calls before a stack overflow error. Defaults to %u.\n", CallStack::DEFAULT_MAX_DEPTH);
+	printf("-O[level]           Optimize the generated bytecode. -O0 (the default) does not optimize, -O1 (or -O) removes redundant loads,\n");
+	printf("                    jumps and unreachable code, -O2 also computes Int arithmetic on literals, assuming that Int, True and\n");
+	printf("                    False keep their default stores. With -b, the bytecode is printed after each optimization pass.\n");
 }
 
 int main(int argc, char *argv[]) {
@@ -118,6 +155,9 @@ int main(int argc, char *argv[]) {
 				case 'r':
 					dump_all_registers = true;
 					break;
+				case 's':
+					dump_statistics = true;
+					break;
 				case 'h':
 					help_message();
 					exit(0);
@@ -133,6 +173,9 @@ int main(int argc, char *argv[]) {
 					}
 					break;
 				}
+				case 'i':
+					write_heap_image = true;
+					break;
 				case 'f': {
 					if (i + 1 == argc || argv[i + 1][0] == '-') {
 						std::cerr << "No file given for -f option.\n";
@@ -161,6 +204,29 @@ int main(int argc, char *argv[]) {
 					} while (end != std::string::npos);
 					break;
 				}
+				case 'c': {
+					if (i + 1 == argc || argv[i + 1][0] == '-') {
+						std::cerr << "No maximum call depth given for -c option.\n";
+						exit(1);
+					}
+					i += 1;
+					char *end;
+					max_call_depth = strtoul(argv[i], &end, 10);
+					if (*end != '\0' || max_call_depth == 0) {
+						std::cerr << "Invalid maximum call depth: " << argv[i] << ".\n";
+						exit(1);
+					}
+					break;
+				}
+				case 'O': {
+					char *end;
+					optimization_level = argv[i][2] == '\0' ? 1 : strtoul(argv[i] + 2, &end, 10);
+					if ((argv[i][2] != '\0' && *end != '\0') || optimization_level > Optimizer::MAX_LEVEL) {
+						std::cerr << "Invalid optimization level: " << argv[i] + 2 << ".\n";
+						exit(1);
+					}
+					break;
+				}
 				default:
 					std::cerr << "Unrecognized option: " << argv[i][1] << "\n";
 			}
@@ -183,8 +249,17 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (filename.has_value())
-		interpret_file(*filename);
-	else
-		interpret_cmdline();
+	try {
+		if (filename.has_value())
+			interpret_file(*filename);
+		else
+			interpret_cmdline();
+	} catch (StampException const &error) {
+		std::cerr << error.to_string() << "\n";
+		exit(1);
+	} catch (std::exception const &error) {
+		// the same as VM::run reports anything else that is thrown while running
+		std::cerr << StampException { StampError::ExecutionError, error.what() }.to_string() << "\n";
+		exit(1);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "VM.h"
+
+// prints the result of a VM run as one line of test output
+inline void show(std::string const &what, VMResult const &result) {
+	std::cout << what << ": ";
+	if (result.ok())
+		std::cout << "ok " << (result.value ? *result.value : "(no value)") << "\n";
+	else
+		std::cout << "error " << result.error->to_string() << "\n";
+}
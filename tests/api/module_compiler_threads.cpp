@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FIXME: only works on unix systems
+#include <stdlib.h>
+
+#include "ModuleCompiler.h"
+#include "VM.h"
+#include "Show.h"
+
+// modules compiled on many threads, by several compilers at once, and with a module that does not compile among them
+static constexpr uint32_t NUM_MODULES = 64;
+
+static void write(std::string const &path, std::string const &text) {
+	std::ofstream(path) << text;
+}
+
+static std::vector<std::string> module_names() {
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i < NUM_MODULES; i++)
+		names.push_back("module_" + std::to_string(i));
+	return names;
+}
+
+static void show(std::string const &what, std::unordered_map<std::string, std::unique_ptr<ObjectFileReader>> const &caches) {
+	uint32_t num_written = 0;
+	for (auto &[path, cache] : caches)
+		num_written += cache != nullptr;
+	std::cout << what << ": " << caches.size() << " modules, " << num_written << " caches\n";
+}
+
+int main() {
+	char dir_template[] = "/tmp/stamp-modules-XXXXXX";
+	std::string dir = mkdtemp(dir_template);
+	std::vector<std::string> dirs = { dir };
+
+	// every module uses the next one and a module all of them share
+	write(dir + "/shared.stamp", "Object shared = 1000;\n");
+	for (uint32_t i = 0; i < NUM_MODULES; i++) {
+		std::string uses = "use shared;\n";
+		if (i + 1 < NUM_MODULES)
+			uses += "use module_" + std::to_string(i + 1) + ";\n";
+		write(dir + "/module_" + std::to_string(i) + ".stamp", uses + "Object value_" + std::to_string(i) + " = Object.shared + " + std::to_string(i) + ";\n");
+	}
+
+	show("8 threads", ModuleCompiler(dirs, 8).compile(module_names()));
+	show("8 threads, cached", ModuleCompiler(dirs, 8).compile(module_names()));
+	show("1 thread, cached", ModuleCompiler(dirs, 1).compile(module_names()));
+
+	// compilers racing to write the same caches
+	system(("rm -rf " + dir + "/.stamp-cache").c_str());
+	std::vector<std::thread> compilers;
+	std::vector<size_t> num_compiled(4);
+	for (uint32_t i = 0; i < num_compiled.size(); i++)
+		compilers.emplace_back([&dirs, &num_compiled, i] { num_compiled[i] = ModuleCompiler(dirs, 4).compile(module_names()).size(); });
+	for (auto &compiler : compilers)
+		compiler.join();
+	for (uint32_t i = 0; i < num_compiled.size(); i++)
+		std::cout << "compiler " << i << " at once: " << num_compiled[i] << " modules\n";
+
+	VMOptions options;
+	options.dirs = dirs;
+	VM vm(options);
+	show("run", vm.run_source("use module_0;\nObject.value_63;"));
+
+	write(dir + "/module_40.stamp", "Object value_40 = ;\n");
+	try {
+		ModuleCompiler(dirs, 8).compile(module_names());
+		std::cout << "module that does not compile: compiled\n";
+	} catch (StampException const &error) {
+		auto message = error.to_string();
+		message.replace(message.find(dir), dir.size(), "<dir>");
+		std::cout << "module that does not compile: " << message;
+	}
+
+	system(("rm -rf " + dir).c_str());
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// FIXME: only works on unix systems
+#include <stdlib.h>
+
+#include "ObjectFile.h"
+#include "VM.h"
+#include "Show.h"
+
+// VMs made from damaged copies of prelude.ostamp, which fail to load instead of running what they read
+using namespace ObjectFile;
+
+static std::string dir;
+
+static std::vector<uint8_t> read(std::string const &path) {
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+static void write(std::string const &path, std::vector<uint8_t> const &bytes) {
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+}
+
+static Header &header(std::vector<uint8_t> &bytes) {
+	return *reinterpret_cast<Header*>(bytes.data());
+}
+
+static SectionEntry &section(std::vector<uint8_t> &bytes, Section section) {
+	return reinterpret_cast<SectionEntry*>(bytes.data() + sizeof(Header))[static_cast<uint32_t>(section)];
+}
+
+static uint32_t *code(std::vector<uint8_t> &bytes) {
+	return reinterpret_cast<uint32_t*>(bytes.data() + section(bytes, Section::Code).offset);
+}
+
+// for damage that the checksum would otherwise catch first
+static void fix_checksum(std::vector<uint8_t> &bytes) {
+	header(bytes).checksum = checksum(bytes.data() + sizeof(Header), bytes.size() - sizeof(Header));
+}
+
+static void load(std::string const &what, std::function<void(std::vector<uint8_t>&)> const &damage) {
+	auto bytes = read("prelude.ostamp");
+	damage(bytes);
+	VMOptions options;
+	options.prelude = dir + "/prelude.ostamp";
+	write(options.prelude, bytes);
+	try {
+		VM vm(options);
+		show(what, vm.run_source("Object x = 3;\nObject.x * 2;"));
+	} catch (StampException const &error) {
+		auto message = error.to_string();
+		message.replace(message.find(dir), dir.size(), "<dir>");
+		std::cout << what << ": error " << message << "\n";
+	}
+}
+
+int main() {
+	char dir_template[] = "/tmp/stamp-object-file-XXXXXX";
+	dir = mkdtemp(dir_template);
+
+	load("intact", [](auto &) {});
+	load("bad magic", [](auto &bytes) { bytes[0] = 'X'; });
+	load("newer version", [](auto &bytes) { header(bytes).version = VERSION + 1; });
+	load("other byte order", [](auto &bytes) { header(bytes).byte_order = 0x04030201; });
+	load("corrupt code", [](auto &bytes) {
+		auto &code = section(bytes, Section::Code);
+		bytes[code.offset + code.size / 2] ^= 0xff;
+	});
+	load("truncated file", [](auto &bytes) { bytes.resize(bytes.size() / 2); });
+	load("empty file", [](auto &bytes) { bytes.clear(); });
+	load("section past the end of the file", [](auto &bytes) {
+		section(bytes, Section::Code).size = bytes.size();
+		fix_checksum(bytes);
+	});
+	load("section of partial records", [](auto &bytes) {
+		section(bytes, Section::Blocks).size -= 1;
+		fix_checksum(bytes);
+	});
+	load("heap image object before its prototype", [](auto &bytes) {
+		auto &objects = section(bytes, Section::Objects);
+		reinterpret_cast<ObjectRecord*>(bytes.data() + objects.offset)[0].prototype = objects.count;
+		fix_checksum(bytes);
+	});
+	// the prelude is read first, so its blocks are not relocated, but its code is checked all the same. It begins
+	// with a Load of six words: Load, destination register, name, is_local, depth and slot.
+	load("jump to a nonexistent block", [](auto &bytes) {
+		uint32_t jumps[] = { 0x04, 0x7fffffff, 0x04, 0, 0x04, 0 };
+		memcpy(code(bytes), jumps, sizeof(jumps));
+		fix_checksum(bytes);
+	});
+	load("load into the last register", [](auto &bytes) {
+		code(bytes)[1] = 0xffffffff;
+		fix_checksum(bytes);
+	});
+
+	// files that fail to load are unmapped again
+	std::ifstream maps("/proc/self/maps");
+	int mappings = 0;
+	for (std::string line; std::getline(maps, line);)
+		mappings += line.find(dir) != std::string::npos;
+	std::cout << "mappings left: " << mappings << "\n";
+
+	system(("rm -rf " + dir).c_str());
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <iostream>
+#include <string>
+
+#include "VM.h"
+#include "Show.h"
+
+// sources too large to keep as test files: nesting past the parser's limit, and lists and chains long enough to
+// overflow the stack if they were parsed or generated recursively
+static std::string repeat(std::string const &text, uint32_t times) {
+	std::string out;
+	for (uint32_t i = 0; i < times; i++)
+		out += text;
+	return out;
+}
+
+static std::string nested_vecs(uint32_t depth) {
+	return "Object v = " + repeat("[", depth) + repeat("]", depth) + ";\n1;";
+}
+
+static std::string nested_ifs(uint32_t depth) {
+	return repeat("if True {\n", depth) + "mut Object x = 1;\n" + repeat("}\n", depth) + "Object.x;";
+}
+
+int main() {
+	VM vm;
+	show("vectors 500 deep", vm.run_source(nested_vecs(500), "vecs"));
+	show("vectors 1001 deep", vm.run_source(nested_vecs(1001), "vecs"));
+	show("blocks 300 deep", vm.run_source(nested_ifs(300), "ifs"));
+	show("blocks 1000 deep", vm.run_source(nested_ifs(1000), "ifs"));
+	show("blocks 1001 deep", vm.run_source(nested_ifs(1001), "ifs"));
+	show("calls 1001 deep", vm.run_source("Object id = fn(a) {\n\treturn a;\n}\n" + repeat("Object.id(", 1001) + "1" + repeat(")", 1001) + ";", "calls"));
+	show("after nesting errors", vm.run_source("1 + 2;"));
+
+	show("arguments to an object", vm.run_source("Object x = Object foo;", "object_arguments"));
+	show("arguments to a literal", vm.run_source("Object x = 5 foo;", "literal_arguments"));
+	show("after argument errors", vm.run_source("3 + 4;"));
+
+	show("100000 statements", vm.run_source("C = Object^;\nmut C i = 0;\n" + repeat("mut C i = C.i + 1;\n", 100000) + "C.i;"));
+	show("100000 statements in a function", vm.run_source("Object count = fn() {\n\tmut C i = 0;\n" + repeat("\tmut C i = C.i + 1;\n", 100000) + "\treturn C.i;\n}\nObject.count();"));
+	show("chain of 500000 messages", vm.run_source("0" + repeat(" + 1", 500000) + ";"));
+	show("vector of 200000 elements", vm.run_source("Object w = [" + repeat("1, ", 199999) + "1];\nObject.w.get 199999;"));
+	show("200000 parameters", vm.run_source("Object many = fn(" + repeat("a, ", 199999) + "b) {\n\treturn b;\n}\nObject many_ok = 1;\nObject.many_ok;"));
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2022, Pavlo Pastaryev <p.pastaryev@gmail.com>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <iostream>
+#include <string>
+
+#include "VM.h"
+#include "Show.h"
+
+// errors come back as results, and the VM keeps working after them
+int main() {
+	VM vm;
+	show("store", vm.run_source("Object x = 3 + 4;"));
+	show("read", vm.run_source("Object.x * 2;"));
+
+	show("parse error", vm.run_source("Object y = ;", "parse_error"));
+	show("nothing of the failed parse is kept", vm.run_source("Object.y;"));
+	show("after parse error", vm.run_source("Object.x + 1;"));
+
+	show("lexing error", vm.run_source("Object c = '123';", "lexing_error"));
+	show("after lexing error", vm.run_source("Object.x;"));
+
+	show("missing store", vm.run_source("Object.nope(1);"));
+	show("division by zero", vm.run_source("Object z = 5;\nObject.x / 0;"));
+	show("what ran before the error is kept", vm.run_source("Object.z;"));
+	show("overflow", vm.run_source("2147483647 + 1;"));
+	show("Vec index past the end", vm.run_source("Object l = [1, 2];\nObject.l.get 5;"));
+	show("negative Vec index", vm.run_source("Object at = fn(i) {\n\treturn Object.l.get i;\n}\nObject.at(0 - 1);"));
+	show("after Vec index errors", vm.run_source("Object.at(1);"));
+
+	show("function", vm.run_source("Object add = fn(a, b) {\n\treturn a + b;\n}\nObject.add(20, 22);"));
+	// not a tail call, which would run forever instead
+	show("stack overflow", vm.run_source("Object down = fn(n) {\n\tT = Object^;\n\tT r = Object.down(n + 1);\n\treturn T.r;\n}\nObject.down(0);"));
+	show("after stack overflow", vm.run_source("Object.add(1, 2);"));
+
+	show("missing file", vm.run_file("tests/api/does_not_exist.stamp"));
+	show("missing use", vm.run_source("use does_not_exist;"));
+	show("after missing use", vm.run_source("Object.add(Object.x, 1);"));
+
+	vm.reset();
+	show("reset drops what ran since the prelude", vm.run_source("Object.x;"));
+	show("after reset", vm.run_source("1 + 2;"));
+
+	try {
+		VMOptions options;
+		options.prelude = "does_not_exist.ostamp";
+		VM broken(options);
+		std::cout << "missing prelude: ok\n";
+	} catch (StampException const &error) {
+		std::cout << "missing prelude: error " << error.to_string() << "\n";
+	}
+	show("after missing prelude", vm.run_source("2 * 3;"));
+}